@@ -1,38 +1,231 @@
 #include "AVLTree.h"
-
+#include "AVLTreeFormat.h"
+#include "KeyCompare.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <string>
+#include <thread>
+
+//Instrumentation hooks. Without AVLTREE_STATS they expand to nothing, so the counters cost nothing
+#ifdef AVLTREE_STATS
+#define AVLTREE_COUNT(counter) (statistics.counter++)
+#define AVLTREE_ADD(counter, amount) (statistics.counter += (amount))
+#define AVLTREE_RECORD_DEPTH(depth) (statistics.searchDepth[depth]++)
+#else
+#define AVLTREE_COUNT(counter) ((void)0)
+#define AVLTREE_ADD(counter, amount) ((void)0)
+#define AVLTREE_RECORD_DEPTH(depth) ((void)0)
+#endif
 
 
-//default constructor that sets the root pointer to null pointer
+//default constructor that sets the root pointer to null pointer and gives the tree its own node pool
 AVLTree::AVLTree()
 {
     root = nullptr;
     treeSize = 0;
+    pool = make_shared<NodePool>();
+    parallelCutoff = DEFAULT_PARALLEL_CUTOFF;
+    relaxedBalance = false;
+}
+
+//constructor that takes its nodes from a pool that may be shared with other trees
+AVLTree::AVLTree(shared_ptr<NodePool> nodePool)
+{
+    root = nullptr;
+    treeSize = 0;
+    pool = nodePool ? std::move(nodePool) : make_shared<NodePool>();
+    parallelCutoff = DEFAULT_PARALLEL_CUTOFF;
+    relaxedBalance = false;
 }
 
-//copy constructor that takes another tree and copys all value into tree on left hand side
+//constructor that builds a balanced tree from a list of key-value pairs
+AVLTree::AVLTree(vector<pair<KeyType, ValueType>> entries)
+{
+    root = nullptr;
+    treeSize = 0;
+    pool = make_shared<NodePool>();
+    parallelCutoff = DEFAULT_PARALLEL_CUTOFF;
+    relaxedBalance = false;
+    buildFromSorted(std::move(entries));
+}
+
+//copy constructor that shares all nodes of the other tree instead of copying them
 AVLTree::AVLTree(const AVLTree& otherTree)
 {
-    root = copy(otherTree.root);
+    //the pool has to be set before shareNode() might need to copy nodes
+    pool = otherTree.pool;
+    parallelCutoff = otherTree.parallelCutoff;
+    relaxedBalance = otherTree.relaxedBalance;
+    root = shareNode(otherTree.root);
     treeSize = otherTree.treeSize;
+    if (otherTree.hotCache)
+    {
+        setHotCacheSize(otherTree.hotCache->slotCount);
+    }
 }
 
-//Inserts a new node. Starts the insert process and calls a recursive method
+//Inserts a new node. The key is copied only if it is not already in the tree
 bool AVLTree::insert(const std::string& key, size_t value)
 {
     //variable that stores whether or not the new node was able to be inserted
-    bool success = insertRecursive(root, key, value);
-    if (success)
+    bool inserted;
+    findOrInsert(key, nullptr, value, inserted);
+    return inserted;
+}
+
+//Inserts a new node, moving the key into it. A key that is already in the tree is left untouched
+bool AVLTree::insert(KeyType&& key, ValueType value)
+{
+    bool inserted;
+    findOrInsert(key, &key, value, inserted);
+    return inserted;
+}
+
+//inserts the key or overwrites its value, with the same single descent as insert
+bool AVLTree::insert_or_assign(const KeyType& key, ValueType value)
+{
+    bool inserted;
+    AVLNode* node = findOrInsert(key, nullptr, value, inserted);
+    node->value = value;
+    return inserted;
+}
+
+bool AVLTree::insert_or_assign(KeyType&& key, ValueType value)
+{
+    bool inserted;
+    AVLNode* node = findOrInsert(key, &key, value, inserted);
+    node->value = value;
+    return inserted;
+}
+
+//walks down like findOrInsert, copying shared nodes so the found one can change. On a miss the copies
+//hold the same keys and values as the nodes they replace, so the contents are unchanged
+bool AVLTree::assign(std::string_view key, ValueType value)
+{
+    PrefixBounds bounds;
+    AVLNode** slot = &root;
+    while (*slot != nullptr)
     {
-        //increase size of tree on success
-        treeSize++;
+        AVLNode* original = *slot;
+        AVLNode* node = mutableNode(*slot);
+        if (node != original)
+        {
+            invalidateHotCache();
+        }
+        int comparison = compareKey(key, node->key, bounds);
+        if (comparison == 0)
+        {
+            node->value = value;
+            return true;
+        }
+        slot = comparison < 0 ? &node->left : &node->right;
     }
-    return success;
+    return false;
+}
+
+//same as insert, under the name the standard containers use
+bool AVLTree::try_emplace(const KeyType& key, ValueType value)
+{
+    return insert(key, value);
+}
+
+bool AVLTree::try_emplace(KeyType&& key, ValueType value)
+{
+    return insert(std::move(key), value);
+}
+
+//Replaces the tree with a perfectly balanced one built from the given pairs
+void AVLTree::buildFromSorted(vector<pair<KeyType, ValueType>> entries)
+{
+    invalidateHotCache();
+    clear(root);
+    treeSize = 0;
+
+    auto keyLess = [](const pair<KeyType, ValueType>& a, const pair<KeyType, ValueType>& b) {
+        return a.first < b.first;
+    };
+    auto keyEqual = [](const pair<KeyType, ValueType>& a, const pair<KeyType, ValueType>& b) {
+        return a.first == b.first;
+    };
+
+    //already sorted input skips straight to the linear build.
+    //stable_sort keeps duplicates in their original order so unique() keeps the first one
+    if (!is_sorted(entries.begin(), entries.end(), keyLess))
+    {
+        stable_sort(entries.begin(), entries.end(), keyLess);
+    }
+    entries.erase(unique(entries.begin(), entries.end(), keyEqual), entries.end());
+
+    if (entries.empty())
+    {
+        return;
+    }
+
+    AVLNode* block = pool->allocateBlock(entries.size());
+    AVLTREE_ADD(allocations, entries.size());
+    root = buildBalanced(entries, 0, entries.size(), block);
+    treeSize = entries.size();
+}
+
+//inserts a batch. Small unsorted batches go through insert one key at a time. When the batch is
+//large compared to the tree, merging it with the tree's contents and rebuilding is cheaper than
+//m descents with rotations
+size_t AVLTree::insertMany(span<const pair<KeyType, ValueType>> entries)
+{
+    size_t sizeBefore = treeSize;
+    auto keyLess = [](const pair<KeyType, ValueType>& a, const pair<KeyType, ValueType>& b) {
+        return a.first < b.first;
+    };
+
+    if (root == nullptr)
+    {
+        buildFromSorted(vector<pair<KeyType, ValueType>>(entries.begin(), entries.end()));
+        return treeSize;
+    }
+
+    //rebuilding costs O(n + m), inserting one by one about O(m log n). A rebuild also replaces every node,
+    //so a tree that shares its nodes with copies, or keeps a hot cache, inserts one by one to keep them
+    bool sorted = is_sorted(entries.begin(), entries.end(), keyLess);
+    bool keepNodes = root->refCount > 1 || hotCache != nullptr;
+    if (!sorted || keepNodes || entries.size() * bit_width(treeSize) < treeSize)
+    {
+        for (const pair<KeyType, ValueType>& entry : entries)
+        {
+            insert(entry.first, entry.second);
+        }
+        return treeSize - sizeBefore;
+    }
+
+    //merges the tree's pairs with the batch. On equal keys the tree's pair comes first,
+    //so buildFromSorted keeps the existing value
+    vector<pair<KeyType, ValueType>> merged;
+    merged.reserve(treeSize + entries.size());
+    auto next = entries.begin();
+    for (const_iterator it = begin(); it != end(); ++it)
+    {
+        while (next != entries.end() && next->first < it.key())
+        {
+            merged.push_back(*next);
+            ++next;
+        }
+        merged.emplace_back(it.key(), it.value());
+    }
+    merged.insert(merged.end(), next, entries.end());
+
+    buildFromSorted(std::move(merged));
+    return treeSize - sizeBefore;
 }
 
 //Public call for the remove method.
-bool AVLTree::remove(const KeyType& key)
+bool AVLTree::remove(std::string_view key)
 {
+    //the removed key's node may hold another key afterwards, and shared nodes on the path are replaced by copies
+    invalidateHotCache();
     //variable that holds whether or not the node was able to be removed
     bool success = remove(root, key);
     if (success)
@@ -43,137 +236,910 @@ bool AVLTree::remove(const KeyType& key)
     return success;
 }
 
+//cuts the tree at key with the same split the set operations use. The node holding key itself, if any,
+//becomes the smallest node of the upper tree
+AVLTree AVLTree::split(std::string_view key)
+{
+    rebalance();
+    invalidateHotCache();
+    AVLTree upper(pool);
+    upper.parallelCutoff = parallelCutoff;
+    upper.relaxedBalance = relaxedBalance;
+    AVLNode* below;
+    AVLNode* above;
+    AVLNode* found = split(root, key, below, above);
+    if (found != nullptr)
+    {
+        above = join(nullptr, found, above);
+    }
+
+    root = below;
+    treeSize = getSize(below);
+    upper.root = above;
+    upper.treeSize = getSize(above);
+    return upper;
+}
+
+//splits off everything below lowKey, then everything above highKey from the rest. What is left in
+//between is dropped with clear, which stops at subtrees shared with other trees
+size_t AVLTree::eraseRange(std::string_view lowKey, std::string_view highKey)
+{
+    if (highKey < lowKey)
+    {
+        return 0;
+    }
+    rebalance();
+    invalidateHotCache();
+
+    AVLNode* below;
+    AVLNode* rest;
+    AVLNode* foundLow = split(root, lowKey, below, rest);
+    AVLNode* inRange;
+    AVLNode* above;
+    AVLNode* foundHigh = split(rest, highKey, inRange, above);
+
+    size_t erased = getSize(inRange);
+    clear(inRange);
+    //the nodes holding the two bound keys are in the range too
+    for (AVLNode* bound : {foundLow, foundHigh})
+    {
+        if (bound != nullptr)
+        {
+            pool->release(bound);
+            erased++;
+        }
+    }
+
+    root = join(below, above);
+    treeSize -= erased;
+    return erased;
+}
+
+//Set operations. Each one takes a reference to the other tree's root and hands it to a recursive helper,
+//so the other tree is never changed: any of its nodes the helper needs to change is copied first.
+//Their joins need subtrees in AVL balance, so a tree that relaxed mode left out of it is rebalanced first;
+//for the other tree that is done on a copy
+//nodes of another pool are copied into this one before they can become part of this tree,
+//since this tree would otherwise release them into the wrong pool, or outlive their slabs
+void AVLTree::unionWith(const AVLTree& other)
+{
+    if (other.hasDirtyNodes())
+    {
+        AVLTree balanced(other);
+        balanced.rebalance();
+        unionWith(balanced);
+        return;
+    }
+    rebalance();
+    invalidateHotCache();
+    AVLNode* theirs = other.pool == pool ? shareNode(other.root) : copy(other.root);
+    size_t forks = parallelForks(min(getSize(root), getSize(theirs)));
+    pool->locking = forks > 0;
+    root = unionNodes(root, theirs, forks);
+    pool->locking = false;
+    treeSize = getSize(root);
+}
+
+//only keys are read from the other tree's nodes, and the copies made of them come from this tree's pool,
+//so no copy is needed when the pools differ
+void AVLTree::intersectWith(const AVLTree& other)
+{
+    if (other.hasDirtyNodes())
+    {
+        AVLTree balanced(other);
+        balanced.rebalance();
+        intersectWith(balanced);
+        return;
+    }
+    rebalance();
+    invalidateHotCache();
+    AVLNode* theirs = shareNode(other.root);
+    size_t forks = parallelForks(min(getSize(root), getSize(theirs)));
+    pool->locking = forks > 0;
+    root = intersectNodes(root, theirs, forks);
+    pool->locking = false;
+    treeSize = getSize(root);
+}
+
+void AVLTree::differenceWith(const AVLTree& other)
+{
+    if (other.hasDirtyNodes())
+    {
+        AVLTree balanced(other);
+        balanced.rebalance();
+        differenceWith(balanced);
+        return;
+    }
+    rebalance();
+    invalidateHotCache();
+    AVLNode* theirs = shareNode(other.root);
+    size_t forks = parallelForks(min(getSize(root), getSize(theirs)));
+    pool->locking = forks > 0;
+    root = differenceNodes(root, theirs, forks);
+    pool->locking = false;
+    treeSize = getSize(root);
+}
+
+size_t AVLTree::filter(const function<bool(const KeyType&, const ValueType&)>& predicate)
+{
+    rebalance();
+    invalidateHotCache();
+    size_t oldSize = treeSize;
+    size_t forks = parallelForks(treeSize);
+    pool->locking = forks > 0;
+    root = filterNodes(root, predicate, forks);
+    pool->locking = false;
+    treeSize = getSize(root);
+    return oldSize - treeSize;
+}
+
+
+//searches the tree for a given key
+bool AVLTree::contains(std::string_view key) const
+{
+    return findCachedNode(key) != nullptr;
+}
+
+//public call for the get mehtod that searches for the node holding the key
+optional<size_t> AVLTree::get(std::string_view key) const
+{
+    AVLNode* node = findCachedNode(key);
+    //null node means the key was not found
+    if (node == nullptr)
+    {
+        return nullopt;
+    }
+    return node->value;
+}
+
+//batch lookups
+vector<optional<AVLTree::ValueType>> AVLTree::getMany(span<const std::string_view> keys) const
+{
+    return getManyKeys(keys);
+}
+
+vector<optional<AVLTree::ValueType>> AVLTree::getMany(span<const KeyType> keys) const
+{
+    return getManyKeys(keys);
+}
+
+//picks the finger search for sorted batches and the interleaved search for everything else
+template <class Key>
+vector<optional<AVLTree::ValueType>> AVLTree::getManyKeys(span<const Key> keys) const
+{
+    vector<optional<ValueType>> results(keys.size());
+    auto keyLess = [](const Key& a, const Key& b) {
+        return std::string_view(a) < std::string_view(b);
+    };
+
+    if (is_sorted(keys.begin(), keys.end(), keyLess))
+    {
+        getManySorted(keys, results);
+    }else
+    {
+        getManyInterleaved(keys, results);
+    }
+    return results;
+}
+
+//finger search over ascending keys. The path of the previous lookup is kept along with, for each node
+//on it, the nearest ancestor the walk went left at, which is the upper bound of that node's subtree.
+//The next key only climbs back to the first node whose subtree can still contain it, so neighbouring
+//keys share most of their path instead of starting again from the root
+template <class Key>
+void AVLTree::getManySorted(span<const Key> keys, vector<optional<ValueType>>& results) const
+{
+    AVLNode* path[MAX_HEIGHT];
+    AVLNode* upperBound[MAX_HEIGHT];
+    size_t depth = 0;
+
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        std::string_view key = keys[i];
+
+        //every key in a subtree is below its upper bound. Keys only grow, so once a bound is
+        //reached the subtree under it can be skipped
+        while (depth > 0 && upperBound[depth - 1] != nullptr && compareKey(key, upperBound[depth - 1]->key) >= 0)
+        {
+            depth--;
+        }
+
+        AVLNode* node = root;
+        AVLNode* bound = nullptr;
+        if (depth > 0)
+        {
+            depth--;
+            node = path[depth];
+            bound = upperBound[depth];
+        }
+
+        while (node != nullptr)
+        {
+            path[depth] = node;
+            upperBound[depth] = bound;
+            depth++;
+
+            int comparison = compareKey(key, node->key);
+            if (comparison == 0)
+            {
+                results[i] = node->value;
+                break;
+            }
+            if (comparison < 0)
+            {
+                bound = node;
+                node = node->left;
+            }else
+            {
+                node = node->right;
+            }
+        }
+    }
+}
+
+//runs a group of independent descents in lockstep. Each round moves every unfinished search down one
+//level and prefetches the node it will look at next, so the cache misses of the group overlap
+template <class Key>
+void AVLTree::getManyInterleaved(span<const Key> keys, vector<optional<ValueType>>& results) const
+{
+    constexpr size_t GROUP_SIZE = 8;
+
+    for (size_t start = 0; start < keys.size(); start += GROUP_SIZE)
+    {
+        size_t count = min(GROUP_SIZE, keys.size() - start);
+        AVLNode* nodes[GROUP_SIZE];
+        for (size_t j = 0; j < count; j++)
+        {
+            nodes[j] = root;
+        }
+
+        size_t active = root != nullptr ? count : 0;
+        while (active > 0)
+        {
+            active = 0;
+            for (size_t j = 0; j < count; j++)
+            {
+                AVLNode* node = nodes[j];
+                if (node == nullptr)
+                {
+                    continue;
+                }
+
+                int comparison = compareKey(keys[start + j], node->key);
+                if (comparison == 0)
+                {
+                    results[start + j] = node->value;
+                    nodes[j] = nullptr;
+                    continue;
+                }
+
+                node = comparison < 0 ? node->left : node->right;
+                nodes[j] = node;
+                if (node != nullptr)
+                {
+#if defined(__GNUC__) || defined(__clang__)
+                    __builtin_prefetch(node);
+#endif
+                    active++;
+                }
+            }
+        }
+    }
+}
 
-//calls the recursive contains method that searches the tree for a given key
-bool AVLTree::contains(const std::string& key) const
+//public call for the bracket operator override. Finds the node, inserting a value-initialized one if the key
+//is missing, and returns a reference to its value. The key is only copied when a node is inserted
+size_t& AVLTree::operator[](std::string_view key)
 {
-    return containsRecursive(root, key);
+    bool inserted;
+    return findOrInsert(key, nullptr, ValueType(), inserted)->value;
 }
 
-//public call for the get mehtod that calls the recursive helper method
-optional<size_t> AVLTree::get(const std::string& key) const
+size_t& AVLTree::operator[](KeyType&& key)
 {
-    return getRecursive(root, key);
+    bool inserted;
+    return findOrInsert(key, &key, ValueType(), inserted)->value;
 }
 
-//public call for the bracket operator override. Calls a recursive method to find the value associated with the given key
-size_t& AVLTree::operator[](const std::string& key)
+size_t& AVLTree::operator[](const char* key)
 {
-    return (bracketRecursive(root, key)).value;
+    return (*this)[std::string_view(key)];
 }
 
-//takes in two keys and calls a recursive method to find all keys in between them
-vector<size_t> AVLTree::findRange(const std::string& lowKey, const std::string& highKey) const
+//takes in two keys and walks forward from the first key that is not below lowKey
+vector<size_t> AVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
 {
     //vector that holds the result
     vector<size_t> result;
 
-    findRangeRecursive(root, lowKey, highKey, result);
+    //a single descent to the first key, then a walk that stops at the first key past highKey
+    for (const_iterator it = lower_bound(lowKey); it != end() && compareKey(highKey, it.key()) >= 0; ++it)
+    {
+        result.push_back(it.value());
+    }
     return result;
 }
 
 //Returns all keys in the tree as a vector of string in order
 std::vector<std::string> AVLTree::keys() const
 {
-    //Creates a vector, then calls the recursive method to gather all keys in order from the tree
-    vector<string> keyVector;
-    keysRecursive(root, keyVector);
+    //Creates a vector with a slot for every key, then calls the recursive method to fill it in order
+    vector<string> keyVector(treeSize);
+    keysRecursive(root, keyVector.data(), parallelForks(treeSize));
     return keyVector;
 }
 
-//recursive helper methods that will recusrively call itself to locate the node that has the given key
-optional<size_t> AVLTree::getRecursive(AVLNode* node, const KeyType& key) const
+//three-way comparison used by every descent, so the instrumentation sees each one
+int AVLTree::compareKey(std::string_view key, const KeyType& nodeKey) const
 {
-    //null node means end of tree, which means the key was not found
-    if (node == nullptr)
+    AVLTREE_COUNT(comparisons);
+    AVLTREE_COUNT(nodeVisits);
+    return key.compare(nodeKey);
+}
+
+//compares from the first byte not known to be shared. The mismatch position found on the way is the
+//common prefix with this node, which becomes the new low or high bound for the subtree the descent enters.
+//Without AVLTREE_PREFIX_BOUNDS it is a plain comparison, since comparing a short key in full is cheaper than the bookkeeping
+int AVLTree::compareKey(std::string_view key, const KeyType& nodeKey, [[maybe_unused]] PrefixBounds& bounds) const
+{
+#ifdef AVLTREE_PREFIX_BOUNDS
+    AVLTREE_COUNT(comparisons);
+    AVLTREE_COUNT(nodeVisits);
+    size_t match = min(bounds.low, bounds.high);
+    int comparison = KeyCompare::compare(key, nodeKey, match);
+    if (comparison < 0)
     {
-        return nullopt;
+        bounds.high = match;
+    }else if (comparison > 0)
+    {
+        bounds.low = match;
+    }
+    return comparison;
+#else
+    return compareKey(key, nodeKey);
+#endif
+}
+
+//returns the counters collected so far. They stay at zero unless built with AVLTREE_STATS
+AVLTree::Stats AVLTree::stats() const
+{
+#ifdef AVLTREE_STATS
+    return statistics;
+#else
+    return Stats();
+#endif
+}
+
+//sets all counters back to zero
+void AVLTree::resetStats()
+{
+#ifdef AVLTREE_STATS
+    statistics = Stats();
+#endif
+    if (hotCache)
+    {
+        hotCache->hits = 0;
+        hotCache->misses = 0;
     }
-    //key was found and returns value
-    if (key == node->key)
+}
+
+//a new cache starts out empty, with its counters at zero. Its slots are allocated by the first lookup,
+//so a copy of a tree with a cache, which calls this too, stays O(1)
+void AVLTree::setHotCacheSize(size_t slots)
+{
+    if (slots == 0)
     {
-        return node->value;
+        hotCache.reset();
+        return;
     }
+    hotCache = make_unique<HotCache>();
+    //a power of two, so the slot is found by masking the hash
+    hotCache->slotCount = bit_ceil(slots);
+}
 
-    //Key not found yet, decides which branch to follow to continue searching
-    if (key < node->key)
+AVLTree::HotCacheStats AVLTree::hotCacheStats() const
+{
+    HotCacheStats result;
+    if (hotCache)
     {
-        return getRecursive(node->left, key);
-    }else
+        result.slots = hotCache->slotCount;
+        result.hits = hotCache->hits;
+        result.misses = hotCache->misses;
+    }
+    return result;
+}
+
+void AVLTree::setParallelCutoff(size_t nodes)
+{
+    //a cutoff of 0 would fork on empty subtrees
+    parallelCutoff = max<size_t>(nodes, 1);
+}
+
+size_t AVLTree::getParallelCutoff() const
+{
+    return parallelCutoff;
+}
+
+//leaving relaxed mode rebalances first, since the strict rotations expect subtrees in AVL balance
+void AVLTree::setRelaxedBalance(bool relaxed)
+{
+    if (!relaxed)
     {
-        return getRecursive(node->right, key);
+        rebalance();
     }
+    relaxedBalance = relaxed;
 }
 
-//Recursive helper method for the findRange method
-void AVLTree::findRangeRecursive(AVLNode* node, const KeyType& lowKey, const KeyType& highKey, vector<size_t>& result) const
+bool AVLTree::isRelaxedBalance() const
 {
-    //checks that node is not null
-    if (node == nullptr)
+    return relaxedBalance;
+}
+
+//the rotations can replace shared nodes with copies, which the hot cache may point at
+bool AVLTree::rebalance(size_t budget)
+{
+    if (!hasDirtyNodes())
     {
-        return;
+        return true;
     }
+    invalidateHotCache();
+    return rebalanceSubtree(root, budget);
+}
+
+//writes the records in key order and the index after them. The header goes in last, once the
+//checksum and the index position are known. The file is written under a temporary name and renamed
+//over the old one, so a failed save never leaves a half-written snapshot at path
+bool AVLTree::save(const std::string& path) const
+{
+    using namespace AVLTreeFormat;
 
-    //checks which why to traverse the tree
-    //goes to the left branch
-    if (node->key > lowKey)
+    string temporaryPath = path + ".tmp";
+    ofstream out(temporaryPath, ios::binary | ios::trunc);
+    if (!out)
     {
-        findRangeRecursive(node->left, lowKey, highKey, result);
+        return false;
     }
-    //found a node we are looking for
-    if (node->key >= lowKey && node->key <= highKey)
+
+    FileHeader header = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    uint64_t hash = checksum(nullptr, 0);
+    uint64_t offset = sizeof(header);
+    vector<uint64_t> index;
+    index.reserve(treeSize);
+    bool keysFit = true;
+    for (const_iterator it = begin(); it != end(); ++it)
     {
-        result.push_back(node->value);
+        const KeyType& key = it.key();
+        if (key.size() > UINT32_MAX)
+        {
+            keysFit = false;
+            break;
+        }
+        uint64_t value = it.value();
+        uint32_t keyLength = static_cast<uint32_t>(key.size());
+        char recordHeader[RECORD_HEADER_SIZE];
+        memcpy(recordHeader, &value, sizeof(value));
+        memcpy(recordHeader + sizeof(value), &keyLength, sizeof(keyLength));
+
+        out.write(recordHeader, sizeof(recordHeader));
+        out.write(key.data(), keyLength);
+        hash = checksum(recordHeader, sizeof(recordHeader), hash);
+        hash = checksum(key.data(), keyLength, hash);
+        index.push_back(offset);
+        offset += sizeof(recordHeader) + keyLength;
     }
-    //goes to the right branch
-    if (node->key < highKey)
+
+    //pads the records so the index starts on an 8-byte boundary of the mapped file
+    char padding[sizeof(uint64_t)] = {};
+    size_t paddingLength = (sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t);
+    out.write(padding, paddingLength);
+    hash = checksum(padding, paddingLength, hash);
+    offset += paddingLength;
+
+    const char* indexBytes = reinterpret_cast<const char*>(index.data());
+    size_t indexLength = index.size() * sizeof(uint64_t);
+    out.write(indexBytes, indexLength);
+    hash = checksum(indexBytes, indexLength, hash);
+
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.count = index.size();
+    header.indexOffset = offset;
+    header.fileSize = offset + indexLength;
+    header.checksum = hash;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    if (!keysFit || !out || rename(temporaryPath.c_str(), path.c_str()) != 0)
     {
-        findRangeRecursive(node->right, lowKey, highKey, result);
+        std::remove(temporaryPath.c_str());
+        return false;
     }
+    return true;
 }
 
-//Recursive helper method for the bracket operator
-AVLTree::AVLNode& AVLTree::bracketRecursive(AVLNode*& node, const std::string& key)
+//reads the whole file and checks it before touching the tree. The records are already in key order,
+//so buildFromSorted skips its sort and the rebuild is linear
+bool AVLTree::load(const std::string& path)
 {
-    //checks for null node
-    if (node == nullptr)
+    using namespace AVLTreeFormat;
+
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in)
+    {
+        return false;
+    }
+    streamoff fileSize = in.tellg();
+    if (fileSize < static_cast<streamoff>(sizeof(FileHeader)))
+    {
+        return false;
+    }
+    string contents(fileSize, '\0');
+    in.seekg(0);
+    if (!in.read(contents.data(), fileSize))
+    {
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    if (!headerIsValid(header, fileSize)
+        || checksum(contents.data() + sizeof(header), fileSize - sizeof(header)) != header.checksum)
+    {
+        return false;
+    }
+
+    vector<pair<KeyType, ValueType>> entries;
+    entries.reserve(header.count);
+    for (uint64_t i = 0; i < header.count; i++)
+    {
+        string_view key;
+        uint64_t value;
+        if (!readRecord(contents.data(), header, i, key, value))
+        {
+            return false;
+        }
+        entries.emplace_back(KeyType(key), value);
+    }
+
+    buildFromSorted(std::move(entries));
+    return true;
+}
+
+//a slot is only trusted if it was filled after the last change that could have freed or copied its node,
+//so the node is still part of this tree and its key can be compared directly
+AVLTree::AVLNode* AVLTree::findCachedNode(std::string_view key) const
+{
+    if (!hotCache)
+    {
+        return findNode(key);
+    }
+
+    if (hotCache->slots.empty())
+    {
+        hotCache->slots.resize(hotCache->slotCount);
+    }
+    HotCache::Slot& slot = hotCache->slots[hash<std::string_view>()(key) & (hotCache->slotCount - 1)];
+    if (slot.version == hotCache->version && slot.node->key == key)
+    {
+        hotCache->hits++;
+        return slot.node;
+    }
+    hotCache->misses++;
+    AVLNode* node = findNode(key);
+    if (node != nullptr)
+    {
+        slot.node = node;
+        slot.version = hotCache->version;
+    }
+    return node;
+}
+
+void AVLTree::invalidateHotCache()
+{
+    if (hotCache)
+    {
+        hotCache->version++;
+    }
+}
+
+//walks down from the root to the node with the given key. Returns null if the key is not in the tree
+AVLTree::AVLNode* AVLTree::findNode(std::string_view key) const
+{
+    //number of nodes passed before the last one, for the search depth histogram
+    [[maybe_unused]] size_t depth = 0;
+    PrefixBounds bounds;
+    AVLNode* node = root;
+    while (node != nullptr)
+    {
+        //one three-way comparison per level decides between found, left and right
+        int comparison = compareKey(key, node->key, bounds);
+        if (comparison == 0)
+        {
+            AVLTREE_RECORD_DEPTH(depth);
+            return node;
+        }
+        node = comparison < 0 ? node->left : node->right;
+        depth++;
+    }
+    AVLTREE_RECORD_DEPTH(depth);
+    return nullptr;
+}
+
+//number of keys less than the given key
+size_t AVLTree::rank(std::string_view key) const
+{
+    return countBelow(key, false);
+}
+
+//walks down from the root using subtree sizes to skip over everything left of the wanted position
+AVLTree::const_iterator AVLTree::select(size_t index) const
+{
+    const_iterator it;
+    it.root = root;
+    if (index >= treeSize)
     {
-        return *node;
+        return it;
     }
 
-    //goes left
-    if (key < node->key)
+    AVLNode* node = root;
+    while (node != nullptr)
     {
-        return bracketRecursive(node->left, key);
+        AVLTREE_COUNT(nodeVisits);
+        it.path[it.depth++] = node;
+        size_t leftSize = getSize(node->left);
+        if (index < leftSize)
+        {
+            node = node->left;
+        }
+        else if (index == leftSize)
+        {
+            return it;
+        }else
+        {
+            index -= leftSize + 1;
+            node = node->right;
+        }
     }
-    //goes right
-    else if (key > node->key)
+    return it;
+}
+
+//number of keys between lowKey and highKey, both included, like findRange
+size_t AVLTree::countRange(std::string_view lowKey, std::string_view highKey) const
+{
+    if (highKey < lowKey)
     {
-        return bracketRecursive(node->right, key);
+        return 0;
     }
-    //node found
-    else
+    return countBelow(highKey, true) - countBelow(lowKey, false);
+}
+
+//counts the keys less than (or also equal to) the given key in one descent.
+//Every time the walk goes right, the node and its whole left subtree are below the key
+size_t AVLTree::countBelow(std::string_view key, bool inclusive) const
+{
+    size_t count = 0;
+    PrefixBounds bounds;
+    AVLNode* node = root;
+    while (node != nullptr)
     {
-        return *node;
+        int comparison = compareKey(key, node->key, bounds);
+        if (comparison < 0 || (comparison == 0 && !inclusive))
+        {
+            node = node->left;
+        }else
+        {
+            count += getSize(node->left) + 1;
+            node = node->right;
+        }
     }
+    return count;
+}
+
+//iterator to the smallest key
+AVLTree::const_iterator AVLTree::begin() const
+{
+    const_iterator it;
+    it.root = root;
+    if (root != nullptr)
+    {
+        it.descendLeft(root);
+    }
+    return it;
+}
+
+//iterator past the largest key
+AVLTree::const_iterator AVLTree::end() const
+{
+    const_iterator it;
+    it.root = root;
+    return it;
+}
+
+//first key >= key
+AVLTree::const_iterator AVLTree::lower_bound(std::string_view key) const
+{
+    return seek(key, true);
+}
 
+//first key > key
+AVLTree::const_iterator AVLTree::upper_bound(std::string_view key) const
+{
+    return seek(key, false);
+}
+
+//both bounds of a key
+pair<AVLTree::const_iterator, AVLTree::const_iterator> AVLTree::equal_range(std::string_view key) const
+{
+    return {lower_bound(key), upper_bound(key)};
+}
+
+//walks down from the root remembering the path. The answer is the last node where the walk went left,
+//so cutting the path back to that node leaves the iterator on it
+AVLTree::const_iterator AVLTree::seek(std::string_view key, bool inclusive) const
+{
+    const_iterator it;
+    it.root = root;
 
+    size_t answerDepth = 0;
+    PrefixBounds bounds;
+    AVLNode* node = root;
+    while (node != nullptr)
+    {
+        it.path[it.depth++] = node;
+        int comparison = compareKey(key, node->key, bounds);
+        if (comparison < 0 || (comparison == 0 && inclusive))
+        {
+            answerDepth = it.depth;
+            node = node->left;
+        }else
+        {
+            node = node->right;
+        }
+    }
+
+    it.depth = answerDepth;
+    return it;
 }
 
-//recursive helper to release all nodes from memory
+
+//recursive helper to drop this tree's nodes. A node still used by another tree loses one reference,
+//and its children stay referenced by it, so the walk stops there
 void AVLTree::clear(AVLNode*& node)
 {
-    //goes through the tree with in-order traversal
+    //large trees are walked in parallel, and the released nodes handed to the pool in one step
+    size_t forks = node != nullptr ? parallelForks(getSize(node)) : 0;
+    if (forks > 0)
+    {
+        AVLNode* first = nullptr;
+        AVLNode* last = nullptr;
+        collectUnused(node, first, last, forks);
+        if (first != nullptr)
+        {
+            pool->releaseChain(first, last);
+        }
+        node = nullptr;
+        return;
+    }
+
+    //goes through the tree with post-order traversal
     if (node!= nullptr)
     {
-        //clears left and right subtrees recursively before deleting the root node
+        if (node->refCount > 1)
+        {
+            node->refCount--;
+            node = nullptr;
+            return;
+        }
+
+        //clears left and right subtrees recursively before releasing the root node
         clear(node->left);
         clear(node->right);
-        delete node;
+        pool->release(node);
         node = nullptr;
     }
 }
 
+//a node is reached through one parent only, so threads walking different subtrees never touch the same
+//reference count. The chain is the node, then the left subtree's chain, then the right subtree's
+void AVLTree::collectUnused(AVLNode* node, AVLNode*& first, AVLNode*& last, size_t forks)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (node->refCount > 1)
+    {
+        node->refCount--;
+        return;
+    }
+
+    AVLNode* leftFirst = nullptr;
+    AVLNode* leftLast = nullptr;
+    AVLNode* rightFirst = nullptr;
+    AVLNode* rightLast = nullptr;
+    AVLNode* leftChild = node->left;
+    AVLNode* rightChild = node->right;
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    forkJoin(forks, getSize(leftChild),
+             [&] { collectUnused(leftChild, leftFirst, leftLast, nextForks); },
+             [&] { collectUnused(rightChild, rightFirst, rightLast, nextForks); });
+
+    node->right = nullptr;
+    node->left = leftFirst != nullptr ? leftFirst : rightFirst;
+    if (leftLast != nullptr)
+    {
+        leftLast->left = rightFirst;
+    }
+    first = node;
+    last = rightLast != nullptr ? rightLast : (leftLast != nullptr ? leftLast : node);
+}
+
+//adds a reference to a node, or copies its subtree if the reference count is full
+AVLTree::AVLNode* AVLTree::shareNode(AVLNode* node) const
+{
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+    if (node->refCount == MAX_REF_COUNT)
+    {
+        return copy(node);
+    }
+    node->refCount++;
+    return node;
+}
+
+//replaces a shared node with a private copy. The copy points at the same children,
+//so they each gain a reference, and the original loses the one from this slot
+AVLTree::AVLNode* AVLTree::mutableNode(AVLNode*& slot)
+{
+    AVLNode* node = slot;
+    if (node->refCount == 1)
+    {
+        return node;
+    }
+
+    AVLNode* newNode = pool->allocate();
+    AVLTREE_COUNT(allocations);
+    newNode->refCount = 1;
+    newNode->key = node->key;
+    newNode->value = node->value;
+    newNode->height = node->height;
+    newNode->dirty = node->dirty;
+    newNode->subtreeSize = node->subtreeSize;
+    newNode->left = shareNode(node->left);
+    newNode->right = shareNode(node->right);
+
+    node->refCount--;
+    slot = newNode;
+    return newNode;
+}
+
+//recursive helper that makes the middle entry the root and builds both halves below it.
+//Both halves differ in size by at most one, so every node is balanced without rotations
+AVLTree::AVLNode* AVLTree::buildBalanced(vector<pair<KeyType, ValueType>>& entries, size_t begin, size_t end, AVLNode* block)
+{
+    //empty range (end of tree)
+    if (begin == end)
+    {
+        return nullptr;
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    AVLNode* node = &block[middle];
+    node->refCount = 1;
+    node->dirty = 0;
+    node->key = std::move(entries[middle].first);
+    node->value = entries[middle].second;
+    node->left = buildBalanced(entries, begin, middle, block);
+    node->right = buildBalanced(entries, middle + 1, end, block);
+    updateNode(node);
+    return node;
+}
+
 //recursive copy method that copys all nodes from a start node down are copied and linked together, and ultimatly returning the root
 AVLTree::AVLNode* AVLTree::copy(const AVLNode* node) const
 {
@@ -183,11 +1149,23 @@ AVLTree::AVLNode* AVLTree::copy(const AVLNode* node) const
         return nullptr;
     }
 
+    //a large subtree is copied into one block by several threads
+    size_t forks = parallelForks(node->subtreeSize);
+    if (forks > 0)
+    {
+        AVLNode* block = pool->allocateBlock(node->subtreeSize);
+        return copyInto(node, block, forks);
+    }
+
     //creates a new node and copies the data
-    AVLNode* newNode = new AVLNode();
+    AVLNode* newNode = pool->allocate();
+    AVLTREE_COUNT(allocations);
+    newNode->refCount = 1;
     newNode->key = node->key;
     newNode->value = node->value;
     newNode->height = node->height;
+    newNode->dirty = node->dirty;
+    newNode->subtreeSize = node->subtreeSize;
 
     //Calls copy for children recursively
     newNode->left = copy(node->left);
@@ -197,59 +1175,66 @@ AVLTree::AVLNode* AVLTree::copy(const AVLNode* node) const
     return newNode;
 }
 
-//recursive helper for the keys function to search the tree for all keys
-void AVLTree::keysRecursive(AVLNode* node, vector<string>& keyVector) const
+//the left subtree fills the block before the node's own slot and the right subtree the part after it
+AVLTree::AVLNode* AVLTree::copyInto(const AVLNode* node, AVLNode* block, size_t forks) const
 {
-    //checks for null node (end of tree)
     if (node == nullptr)
     {
-        return;
+        return nullptr;
     }
 
-    //recursive call for the keysRecursive method
-    keysRecursive(node->left, keyVector);
-    //adds current node before right subtree nodes to maintain in-order traversal
-    keyVector.push_back(node->key);
-    keysRecursive(node->right, keyVector);
+    size_t leftSize = getSize(node->left);
+    AVLNode* newNode = &block[leftSize];
+    newNode->refCount = 1;
+    newNode->key = node->key;
+    newNode->value = node->value;
+    newNode->height = node->height;
+    newNode->dirty = node->dirty;
+    newNode->subtreeSize = node->subtreeSize;
+
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    forkJoin(forks, leftSize,
+             [&] { newNode->left = copyInto(node->left, block, nextForks); },
+             [&] { newNode->right = copyInto(node->right, block + leftSize + 1, nextForks); });
+    return newNode;
 }
 
-//recursive method for contains the searches a tree branch for where they key should be located
-bool AVLTree::containsRecursive(AVLNode* node, const string& key) const
+//recursive helper for the keys function to search the tree for all keys
+void AVLTree::keysRecursive(AVLNode* node, string* out, size_t forks) const
 {
-    //if the node is null, then end of tree has been reached and key is not in tree
+    //checks for null node (end of tree)
     if (node == nullptr)
     {
-        return false;
-    }
-    //key found
-    if (key == node->key)
-    {
-        return true;
+        return;
     }
 
-    //if node does not contain key, decide whether to navigate left or right to find it
-    if (key < node->key)
-    {
-        return containsRecursive(node->left, key);
-    }else
-    {
-        return containsRecursive(node->right, key);
-    }
+    //the left subtree's keys come first, so the current key goes right after them
+    size_t leftSize = getSize(node->left);
+    out[leftSize] = node->key;
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    forkJoin(forks, leftSize,
+             [&] { keysRecursive(node->left, out, nextForks); },
+             [&] { keysRecursive(node->right, out + leftSize + 1, nextForks); });
 }
 
+
 //returns how many nodes are in the AVL tree
 size_t AVLTree::size() const
 {
     return treeSize;
 }
 
-//returns the current height of the tree
+//returns the current height of the tree. An empty tree and a single node both have height 0
 size_t AVLTree::getHeight() const
 {
-    return getHeight(root);
+    if (root == nullptr)
+    {
+        return 0;
+    }
+    return root->height;
 }
 
-//= operator override that allows for a copy of a tree to be placed into another tree object
+//= operator override that makes this tree share the nodes of another tree
 void AVLTree::operator=(const AVLTree& otherTree)
 {
     //checks for self-assignment
@@ -259,87 +1244,311 @@ void AVLTree::operator=(const AVLTree& otherTree)
     }
 
     //empties the current tree so that it can be overwritten
+    invalidateHotCache();
     clear(root);
 
-    //copys all nodes from the other tree
-    root = copy(otherTree.root);
+    //shares all nodes from the other tree, which means using its pool as well
+    pool = otherTree.pool;
+    parallelCutoff = otherTree.parallelCutoff;
+    relaxedBalance = otherTree.relaxedBalance;
+    root = shareNode(otherTree.root);
     treeSize = otherTree.treeSize;
+    setHotCacheSize(otherTree.hotCache ? otherTree.hotCache->slotCount : 0);
 }
 
 //class deconstructor
 AVLTree::~AVLTree()
 {
-    //calls the clear method, which recursively frees up the memory that each node in the tree took up.
-    clear(root);
+    //The pool frees its slabs all at once when the last tree using it is destroyed.
+    //If that is this tree, no other tree can share its nodes, so walking them would be wasted work
+    if (pool.use_count() == 1)
+    {
+        return;
+    }
+    //otherwise calls the clear method, which recursively returns every node to the pool
+    clear(root);
+}
+
+//finds the key or the correct location to place a new node by walking down from the root,
+//then rebalances the nodes on the way back up if a node was inserted
+AVLTree::AVLNode* AVLTree::findOrInsert(std::string_view key, KeyType* movableKey, ValueType value, bool& inserted)
+{
+    //slots of the nodes visited on the way down, so the walk back up needs no recursion
+    AVLNode** path[MAX_HEIGHT];
+    size_t depth = 0;
+    PrefixBounds bounds;
+
+    //every node on the path gets a new height and size, so shared ones are copied on the way down.
+    //A copied node replaces one the hot cache may point at. The rotations below only move nodes
+    //on the path, which are unshared by then, so they never make a copy
+    AVLNode** slot = &root;
+    while (*slot != nullptr)
+    {
+        AVLNode* original = *slot;
+        AVLNode* node = mutableNode(*slot);
+        if (node != original)
+        {
+            invalidateHotCache();
+        }
+        int comparison = compareKey(key, node->key, bounds);
+        //duplicate key found. The node is already unshared, so the caller may change its value
+        if (comparison == 0)
+        {
+            inserted = false;
+            return node;
+        }
+        path[depth++] = slot;
+        slot = comparison < 0 ? &node->left : &node->right;
+    }
+
+    //Case where the correct spot is found. Inserts information into a node taken from the pool
+    AVLNode* node = pool->allocate();
+    AVLTREE_COUNT(allocations);
+    node->refCount = 1;
+    //the key is moved last, since key may be a view of *movableKey
+    if (movableKey != nullptr)
+    {
+        node->key = std::move(*movableKey);
+    }else
+    {
+        node->key.assign(key);
+    }
+    node->value = value;
+    node->left = nullptr;
+    node->right = nullptr;
+    node->height = 0;
+    node->dirty = 0;
+    node->subtreeSize = 1;
+    *slot = node;
+
+    //ensures the tree has not been unbalanced due to the new insertion
+    //rotations move nodes between slots but never copy a node that belongs only to this tree,
+    //so the new node is still the one returned
+    rebalancePath(path, depth, 1);
+    treeSize++;
+    inserted = true;
+    return node;
+}
+
+//balances the nodes on a recorded path from the deepest one upwards.
+//Once a subtree keeps its old height, nothing above it needs rebalancing, so the rest of the walk
+//only adjusts subtree sizes by sizeChange
+void AVLTree::rebalancePath(AVLNode** path[], size_t depth, int sizeChange)
+{
+    if (relaxedBalance)
+    {
+        relaxPath(path, depth, sizeChange);
+        return;
+    }
+
+    while (depth > 0)
+    {
+        depth--;
+        AVLNode*& node = *path[depth];
+        int oldHeight = node->height;
+        balanceNode(node);
+        if (node->height == oldHeight)
+        {
+            break;
+        }
+    }
+
+    while (depth > 0)
+    {
+        depth--;
+        (*path[depth])->subtreeSize += sizeChange;
+    }
+}
+
+//the walk stops early like rebalancePath's, once a subtree keeps both its height and its mark. A node is marked
+//when it is out of AVL balance or has a marked child, so every unbalanced node can be reached from the root through marked ones
+void AVLTree::relaxPath(AVLNode** path[], size_t depth, int sizeChange)
+{
+    while (depth > 0)
+    {
+        depth--;
+        AVLNode*& node = *path[depth];
+        int oldHeight = node->height;
+        bool wasDirty = node->dirty;
+        updateNode(node);
+        int balanceFactor = getBalance(node);
+        if (balanceFactor > RELAXED_BALANCE_SLACK || balanceFactor < -RELAXED_BALANCE_SLACK)
+        {
+            restoreSlack(node);
+        }else
+        {
+            markIfUnbalanced(node);
+        }
+        if (node->height == oldHeight && node->dirty == wasDirty)
+        {
+            break;
+        }
+    }
+
+    while (depth > 0)
+    {
+        depth--;
+        (*path[depth])->subtreeSize += sizeChange;
+    }
+}
+
+//A single insert or remove moves a height by one, so a node is at most one past the slack. The rotations balanceNode
+//would make then bring every node they move back within the slack (as they bring an AVL tree back within one),
+//and leave the subtree no taller than before the write. The sibling side may be shared, so the hot cache is emptied
+void AVLTree::restoreSlack(AVLNode*& node)
+{
+    invalidateHotCache();
+    if (getBalance(node) > 0)
+    {
+        if (getBalance(node->left) >= 0)
+        {
+            AVLTREE_COUNT(singleRotations);
+            rotateRight(node);
+            markIfUnbalanced(node->right);
+        }else
+        {
+            AVLTREE_COUNT(doubleRotations);
+            rotateLeft(node->left);
+            rotateRight(node);
+            markIfUnbalanced(node->left);
+            markIfUnbalanced(node->right);
+        }
+    }else
+    {
+        if (getBalance(node->right) <= 0)
+        {
+            AVLTREE_COUNT(singleRotations);
+            rotateLeft(node);
+            markIfUnbalanced(node->left);
+        }else
+        {
+            AVLTREE_COUNT(doubleRotations);
+            rotateRight(node->right);
+            rotateLeft(node);
+            markIfUnbalanced(node->left);
+            markIfUnbalanced(node->right);
+        }
+    }
+    markIfUnbalanced(node);
+}
+
+//recomputes the mark of a node whose children are marked correctly
+void AVLTree::markIfUnbalanced(AVLNode* node) const
+{
+    int balanceFactor = getBalance(node);
+    node->dirty = balanceFactor > 1 || balanceFactor < -1
+                  || (node->left != nullptr && node->left->dirty) || (node->right != nullptr && node->right->dirty);
+}
+
+//post-order, so both subtrees are in AVL balance by the time the node is joined back between them. join then
+//rotates the node down the taller side as far as the heights require, which never makes the subtree taller.
+//A subtree that got shorter can push this node past the slack even when the budget stops the walk below it,
+//so in that case both subtrees are finished regardless, to keep the height bound
+bool AVLTree::rebalanceSubtree(AVLNode*& node, size_t& budget)
+{
+    if (node == nullptr || node->dirty == 0)
+    {
+        return true;
+    }
+    if (budget == 0)
+    {
+        return false;
+    }
+
+    AVLNode* top = mutableNode(node);
+    bool balanced = rebalanceSubtree(top->left, budget);
+    balanced = rebalanceSubtree(top->right, budget) && balanced;
+    updateNode(top);
+    int balanceFactor = getBalance(top);
+    if (!balanced)
+    {
+        if (balanceFactor <= RELAXED_BALANCE_SLACK && balanceFactor >= -RELAXED_BALANCE_SLACK)
+        {
+            return false;
+        }
+        size_t unlimited = SIZE_MAX;
+        rebalanceSubtree(top->left, unlimited);
+        rebalanceSubtree(top->right, unlimited);
+        updateNode(top);
+        balanceFactor = getBalance(top);
+    }
+
+    budget = budget > 0 ? budget - 1 : 0;
+    top->dirty = 0;
+    if (balanceFactor > 1 || balanceFactor < -1)
+    {
+        node = join(top->left, top, top->right);
+    }
+    return true;
+}
+
+bool AVLTree::hasDirtyNodes() const
+{
+    return root != nullptr && root->dirty;
+}
+
+bool AVLTree::isValid() const
+{
+    return getSize(root) == treeSize && isValidSubtree(root, nullptr, nullptr, relaxedBalance);
 }
 
-//recursive helper method the finds the correct location to place the new node
-bool AVLTree::insertRecursive(AVLNode*& node, const KeyType& key, ValueType value)
+//a marked node passes markAllowed on to its children, since a node may only be marked below a marked one
+bool AVLTree::isValidSubtree(AVLNode* node, const KeyType* low, const KeyType* high, bool markAllowed) const
 {
-    //Case where the correct spot is found
     if (node == nullptr)
     {
-        //inserts information into a new node
-        node = new AVLNode();
-        node->key = key;
-        node->value = value;
-        node->left = nullptr;
-        node->right = nullptr;
-        node->height = 0;
         return true;
     }
-
-    //marks success as false because the current node can not be inserted on
-    bool success = false;
-
-    //Continue searching down the tree
-    //goes to the left
-    if (key < node->key)
-    {
-        //if the key is less than current node's key, search it's left branch
-        success = insertRecursive(node->left, key, value);
-    }
-    //goes right
-    else if (key > node->key)
-    {
-        //if the key is greater than the current node's key, search it's right tree
-        success = insertRecursive(node->right, key, value);
-    }else
+    if ((low != nullptr && !(*low < node->key)) || (high != nullptr && !(node->key < *high)))
     {
-        //duplicate key found
-        success = false;
+        return false;
     }
-
-    //calls for the balance function to ensure the tree has not been unbalanced due to the new insertion
-    if (success)
+    int balanceFactor = getBalance(node);
+    int slack = relaxedBalance ? RELAXED_BALANCE_SLACK : 1;
+    if (node->height != 1 + max(getHeight(node->left), getHeight(node->right))
+        || node->subtreeSize != 1 + getSize(node->left) + getSize(node->right)
+        || balanceFactor > slack || balanceFactor < -slack
+        || (node->dirty && !markAllowed)
+        || ((balanceFactor > 1 || balanceFactor < -1) && !node->dirty))
     {
-        balanceNode(node);
+        return false;
     }
-
-    return success;
+    return isValidSubtree(node->left, low, &node->key, node->dirty) && isValidSubtree(node->right, &node->key, high, node->dirty);
 }
 
-//gets the height of a node
+//gets the height of a node. Leaves have height 0, so a missing node counts as -1
 int AVLTree::getHeight(AVLNode* node)
 {
     if (node == nullptr)
     {
-        return 0;
+        return -1;
     }else
     {
         return node->height;
     }
 }
 
-//Updates the node height by getting the height from both of its children and taking the larger height value
-void AVLTree::updateHeight (AVLNode* node)
+//Updates the node height by getting the height from both of its children and taking the larger height value.
+//The subtree size is the node itself plus the sizes of both children
+void AVLTree::updateNode(AVLNode* node)
 {
 
     if (node != nullptr)
     {
         //height is the larger value between its two branches
         node->height = (1 + max(getHeight(node->left), getHeight(node->right)));
+        node->subtreeSize = 1 + getSize(node->left) + getSize(node->right);
+    }
+}
+
+//gets the number of nodes in a subtree and handles null pointers
+size_t AVLTree::getSize(AVLNode* node)
+{
+    if (node == nullptr)
+    {
+        return 0;
     }
+    return node->subtreeSize;
 }
 
 //Calculates a node's balance factor
@@ -362,17 +1571,18 @@ int AVLTree::getBalance(AVLNode* node) const
 //performs a right rotation on a subtree based on a given node
 void AVLTree::rotateRight(AVLNode*& node)
 {
-    //gets nodes involved in the rotation
-    AVLNode* pivot = node->left;
+    //gets nodes involved in the rotation. Both are changed, so neither may be shared with another tree
+    AVLNode* top = mutableNode(node);
+    AVLNode* pivot = mutableNode(top->left);
     AVLNode* hook = pivot->right;
 
     //rotates right
-    pivot->right = node;
-    node->left = hook;
+    pivot->right = top;
+    top->left = hook;
 
-    //updates height of old and new root
-    updateHeight(node);
-    updateHeight(pivot);
+    //updates height and size of old and new root
+    updateNode(top);
+    updateNode(pivot);
 
     //the root node is set to what was the pivot
     node = pivot;
@@ -381,30 +1591,32 @@ void AVLTree::rotateRight(AVLNode*& node)
 //performs a left rotation on a subtree based on a given node
 void AVLTree::rotateLeft(AVLNode*& node)
 {
-    AVLNode* pivot = node->right;
+    //both nodes that change must belong only to this tree
+    AVLNode* top = mutableNode(node);
+    AVLNode* pivot = mutableNode(top->right);
     AVLNode* hook = pivot->left;
 
     //rotate left
-    pivot->left = node;
-    node->right = hook;
+    pivot->left = top;
+    top->right = hook;
 
-    //updates old root's height
-    updateHeight(node);
-    //updates new root's height
-    updateHeight(pivot);
+    //updates old root's height and size
+    updateNode(top);
+    //updates new root's height and size
+    updateNode(pivot);
 
     //update pointer to new root
     node = pivot;
 }
 
-//removes a node from the tree and rebalances as necessary
-bool AVLTree::removeNode(AVLNode*& current){
+//unlinks a node from the tree. In the two-child case the walk continues down to the
+//in-order successor and extends the recorded path, so the caller rebalances everything in one pass
+bool AVLTree::removeNode(AVLNode*& current, AVLNode** path[], size_t& depth){
     if (!current) {
         return false;
     }
 
     AVLNode* toDelete = current;
-    auto nChildren = current->numChildren();
     if (current->isLeaf()) {
         // case 1 we can delete the node
         current = nullptr;
@@ -418,65 +1630,58 @@ bool AVLTree::removeNode(AVLNode*& current){
     } else {
         // case 3 - we have two children,
         // get smallest key in right subtree by
-        // getting right child and go left until left is null
-        AVLNode* smallestInRight = current->right;
-        // I could check if smallestInRight is null,
-        // but it shouldn't be since the node has two children
-        while (smallestInRight->left) {
-            smallestInRight = smallestInRight->left;
+        // getting right child and go left until left is null.
+        // current and every node passed on the way can lose height, so they all go on the path
+        path[depth++] = &current;
+        AVLNode** successorSlot = &current->right;
+        while (mutableNode(*successorSlot)->left) {
+            AVLTREE_COUNT(nodeVisits);
+            path[depth++] = successorSlot;
+            successorSlot = &(*successorSlot)->left;
         }
-        std::string newKey = smallestInRight->key;
-        int newValue = smallestInRight->value;
-        remove(root, smallestInRight->key); // delete this one
-
-        current->key = newKey;
-        current->value = newValue;
-
-        current->height = current->getHeight();
-        balanceNode(current);
 
-        return true; // we already deleted the one we needed to so return
+        // the successor takes current's place in the key order, then is unlinked
+        // like a one-child node since it has no left child
+        AVLNode* successor = *successorSlot;
+        current->key.swap(successor->key);
+        current->value = successor->value;
+        *successorSlot = successor->right;
+        toDelete = successor;
     }
-    delete toDelete;
+    pool->release(toDelete);
 
     return true;
 }
 
-//recursive helper method that finds the node with the key that is to be deleted
-bool AVLTree::remove(AVLNode *&current, KeyType key) {
-    //checks for null node
-    if (current == nullptr)
-    {
-        return false;
-    }
-
-    //variable that determines if value was found
-    bool success = false;
-
-    //goes left
-    if (key < current->key)
-    {
-        success = remove(current->left, key);
-    }
-    //goes right
-    else if (key > current->key)
-    {
-        success = remove(current->right, key);
-    }
-    //node found
-    else
-    {
-        success = removeNode(current);
-    }
-
-    //rebalances the node if the key was removed
-    if (success)
+//finds the node with the key that is to be deleted by walking down from current,
+//then rebalances the nodes above it on the way back up
+bool AVLTree::remove(AVLNode*& current, std::string_view key) {
+    //slots of the nodes above the one being removed
+    AVLNode** path[MAX_HEIGHT];
+    size_t depth = 0;
+    PrefixBounds bounds;
+
+    //the nodes above the removed one change, so shared ones are copied on the way down,
+    //and so is the removed node itself so that removing it cannot affect another tree
+    AVLNode** slot = &current;
+    while (*slot != nullptr)
     {
-        balanceNode(current);
+        AVLNode* node = mutableNode(*slot);
+        int comparison = compareKey(key, node->key, bounds);
+        //node found
+        if (comparison == 0)
+        {
+            removeNode(*slot, path, depth);
+            //rebalances the nodes above the removed one
+            rebalancePath(path, depth, -1);
+            return true;
+        }
+        path[depth++] = slot;
+        slot = comparison < 0 ? &node->left : &node->right;
     }
 
-    return success;
-
+    //key is not in the tree
+    return false;
 }
 
 //takes the given node and determines if it needs
@@ -486,8 +1691,8 @@ void AVLTree::balanceNode(AVLNode *&node) {
         return;
     }
 
-    //updates height
-    updateHeight(node);
+    //updates height and size
+    updateNode(node);
 
     //balance factor should be between -1 and 1
     int balanceFactor = getBalance(node);
@@ -495,29 +1700,266 @@ void AVLTree::balanceNode(AVLNode *&node) {
     //Right rotation needed, leftside heavy
     if (balanceFactor > 1 && getBalance(node->left) >= 0)
     {
+        AVLTREE_COUNT(singleRotations);
         rotateRight(node);
     }
 
     //Left-Right rotation needed
     else if (balanceFactor > 1 && getBalance(node->left) < 0)
     {
+        AVLTREE_COUNT(doubleRotations);
         rotateLeft(node->left);
         rotateRight(node);
     }
 
-    //Right rotation needed, rightside heavy
+    //Left rotation needed, rightside heavy
     else if (balanceFactor < -1 && getBalance(node->right) <= 0)
     {
-        rotateRight(node);
+        AVLTREE_COUNT(singleRotations);
+        rotateLeft(node);
     }
     //Right-left rotation needed
     else if (balanceFactor < -1 && getBalance(node->right) > 0)
     {
+        AVLTREE_COUNT(doubleRotations);
         rotateRight(node->right);
         rotateLeft(node);
     }
 }
 
+//Join-based helpers
+
+AVLTree::AVLNode* AVLTree::join(AVLNode* left, AVLNode* middle, AVLNode* right)
+{
+    //left is too tall: follows its right spine down. The joined subtree is at most one level taller than
+    //the spine node it replaces, so one rotation (or double rotation) per level restores the balance
+    if (getHeight(left) > getHeight(right) + 1)
+    {
+        AVLNode* node = mutableNode(left);
+        node->right = join(node->right, middle, right);
+        balanceNode(left);
+        return left;
+    }
+    //right is too tall: the same down its left spine
+    if (getHeight(right) > getHeight(left) + 1)
+    {
+        AVLNode* node = mutableNode(right);
+        node->left = join(left, middle, node->left);
+        balanceNode(right);
+        return right;
+    }
+
+    //heights within one of each other, so middle can simply become their parent
+    middle->left = left;
+    middle->right = right;
+    updateNode(middle);
+    return middle;
+}
+
+AVLTree::AVLNode* AVLTree::join(AVLNode* left, AVLNode* right)
+{
+    if (left == nullptr)
+    {
+        return right;
+    }
+    AVLNode* last;
+    AVLNode* rest = splitLast(left, last);
+    return join(rest, last, right);
+}
+
+AVLTree::AVLNode* AVLTree::splitLast(AVLNode* node, AVLNode*& last)
+{
+    AVLNode* top = mutableNode(node);
+    if (top->right == nullptr)
+    {
+        last = top;
+        return top->left;
+    }
+    AVLNode* rest = splitLast(top->right, last);
+    return join(top->left, top, rest);
+}
+
+//walks down to the key. Every node on the way goes to the side of the split it belongs on,
+//joined with the subtree it keeps from that side
+AVLTree::AVLNode* AVLTree::split(AVLNode* node, std::string_view key, AVLNode*& left, AVLNode*& right)
+{
+    if (node == nullptr)
+    {
+        left = nullptr;
+        right = nullptr;
+        return nullptr;
+    }
+
+    AVLNode* top = mutableNode(node);
+    int comparison = compareKey(key, top->key);
+    if (comparison == 0)
+    {
+        left = top->left;
+        right = top->right;
+        return top;
+    }
+
+    AVLNode* found;
+    if (comparison < 0)
+    {
+        AVLNode* aboveKey;
+        found = split(top->left, key, left, aboveKey);
+        right = join(aboveKey, top, top->right);
+    }else
+    {
+        AVLNode* belowKey;
+        found = split(top->right, key, belowKey, right);
+        left = join(top->left, top, belowKey);
+    }
+    return found;
+}
+
+//splits this tree's subtree by the root key of the other one, combines the halves on each side and joins
+//them around that key. Whole subtrees of either tree that have nothing to combine with are linked in as they are
+AVLTree::AVLNode* AVLTree::unionNodes(AVLNode* mine, AVLNode* theirs, size_t forks)
+{
+    if (mine == nullptr)
+    {
+        return theirs;
+    }
+    if (theirs == nullptr)
+    {
+        return mine;
+    }
+
+    AVLNode* middle = mutableNode(theirs);
+    AVLNode* theirLeft = middle->left;
+    AVLNode* theirRight = middle->right;
+    AVLNode* myLeft;
+    AVLNode* myRight;
+    AVLNode* found = split(mine, middle->key, myLeft, myRight);
+    //a key in both trees keeps this tree's node and value
+    if (found != nullptr)
+    {
+        pool->release(middle);
+        middle = found;
+    }
+
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    AVLNode* left;
+    AVLNode* right;
+    forkJoin(forks, min(getSize(myLeft), getSize(theirLeft)),
+             [&] { left = unionNodes(myLeft, theirLeft, nextForks); },
+             [&] { right = unionNodes(myRight, theirRight, nextForks); });
+    return join(left, middle, right);
+}
+
+AVLTree::AVLNode* AVLTree::intersectNodes(AVLNode* mine, AVLNode* theirs, size_t forks)
+{
+    if (mine == nullptr || theirs == nullptr)
+    {
+        clear(mine);
+        clear(theirs);
+        return nullptr;
+    }
+
+    AVLNode* middle = mutableNode(theirs);
+    AVLNode* theirLeft = middle->left;
+    AVLNode* theirRight = middle->right;
+    AVLNode* myLeft;
+    AVLNode* myRight;
+    AVLNode* found = split(mine, middle->key, myLeft, myRight);
+    pool->release(middle);
+
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    AVLNode* left;
+    AVLNode* right;
+    forkJoin(forks, min(getSize(myLeft), getSize(theirLeft)),
+             [&] { left = intersectNodes(myLeft, theirLeft, nextForks); },
+             [&] { right = intersectNodes(myRight, theirRight, nextForks); });
+    //keys on both sides of the other tree's root only stay joined through it if this tree has it too
+    return found != nullptr ? join(left, found, right) : join(left, right);
+}
+
+AVLTree::AVLNode* AVLTree::differenceNodes(AVLNode* mine, AVLNode* theirs, size_t forks)
+{
+    if (mine == nullptr || theirs == nullptr)
+    {
+        clear(theirs);
+        return mine;
+    }
+
+    AVLNode* middle = mutableNode(theirs);
+    AVLNode* theirLeft = middle->left;
+    AVLNode* theirRight = middle->right;
+    AVLNode* myLeft;
+    AVLNode* myRight;
+    AVLNode* found = split(mine, middle->key, myLeft, myRight);
+    pool->release(middle);
+    if (found != nullptr)
+    {
+        pool->release(found);
+    }
+
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    AVLNode* left;
+    AVLNode* right;
+    forkJoin(forks, min(getSize(myLeft), getSize(theirLeft)),
+             [&] { left = differenceNodes(myLeft, theirLeft, nextForks); },
+             [&] { right = differenceNodes(myRight, theirRight, nextForks); });
+    return join(left, right);
+}
+
+//filters both subtrees, then joins them around the node if it passes and without it otherwise
+AVLTree::AVLNode* AVLTree::filterNodes(AVLNode* node, const function<bool(const KeyType&, const ValueType&)>& predicate, size_t forks)
+{
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+
+    AVLNode* top = mutableNode(node);
+    size_t nextForks = forks > 0 ? forks - 1 : 0;
+    AVLNode* left;
+    AVLNode* right;
+    forkJoin(forks, getSize(top->left),
+             [&] { left = filterNodes(top->left, predicate, nextForks); },
+             [&] { right = filterNodes(top->right, predicate, nextForks); });
+
+    if (predicate(top->key, top->value))
+    {
+        return join(left, top, right);
+    }
+    pool->release(top);
+    return join(left, right);
+}
+
+//two forks per level, so this allows about twice as many threads as the machine has cores.
+//Counting statistics is not thread-safe, so AVLTREE_STATS builds stay on one thread
+size_t AVLTree::parallelForks(size_t nodes) const
+{
+#ifdef AVLTREE_STATS
+    return 0;
+#else
+    if (nodes < parallelCutoff)
+    {
+        return 0;
+    }
+    return bit_width(max(thread::hardware_concurrency(), 1u));
+#endif
+}
+
+//the halves work on disjoint key ranges, so they never touch the same node
+template <class First, class Second>
+void AVLTree::forkJoin(size_t forks, size_t nodes, First first, Second second) const
+{
+    if (forks > 0 && nodes >= parallelCutoff)
+    {
+        future<void> firstDone = async(launch::async, first);
+        second();
+        firstDone.get();
+    }else
+    {
+        first();
+        second();
+    }
+}
+
 //Node helper methods
 
 //returns the number of children a node has
@@ -552,6 +1994,223 @@ size_t AVLTree::AVLNode::getHeight() const {
     return height;
 }
 
+//Node pool methods
+
+//creates an empty pool. No slab is allocated until the first node is needed
+AVLTree::NodePool::NodePool(size_t nodesPerSlab)
+{
+    this->nodesPerSlab = max<size_t>(nodesPerSlab, 1);
+    slabNext = nullptr;
+    slabEnd = nullptr;
+    nodesCarved = 0;
+    freeList = nullptr;
+    locking = false;
+}
+
+//returns how many nodes have been carved out of the slabs so far
+size_t AVLTree::NodePool::capacity() const
+{
+    return nodesCarved;
+}
+
+//hands out a recycled node if there is one, otherwise the next unused node of the current slab
+AVLTree::AVLNode* AVLTree::NodePool::allocate()
+{
+    unique_lock<std::mutex> lock(mutex, defer_lock);
+    if (locking)
+    {
+        lock.lock();
+    }
+    if (freeList != nullptr)
+    {
+        AVLNode* node = freeList;
+        freeList = node->left;
+        node->left = nullptr;
+        return node;
+    }
+
+    //starts a new slab once the current one is used up
+    if (slabNext == slabEnd)
+    {
+        slabs.push_back(make_unique<AVLNode[]>(nodesPerSlab));
+        slabNext = slabs.back().get();
+        slabEnd = slabNext + nodesPerSlab;
+    }
+
+    AVLNode* node = slabNext;
+    slabNext++;
+    nodesCarved++;
+    node->left = nullptr;
+    node->right = nullptr;
+    return node;
+}
+
+//gives a bulk build its own slab, so the nodes come from a single allocation and sit next to each other.
+//The slab allocate() is carving from is left alone
+AVLTree::AVLNode* AVLTree::NodePool::allocateBlock(size_t count)
+{
+    if (count == 0)
+    {
+        return nullptr;
+    }
+    unique_lock<std::mutex> lock(mutex, defer_lock);
+    if (locking)
+    {
+        lock.lock();
+    }
+    slabs.push_back(make_unique<AVLNode[]>(count));
+    nodesCarved += count;
+    return slabs.back().get();
+}
+
+//links the whole chain in front of the free list
+void AVLTree::NodePool::releaseChain(AVLNode* first, AVLNode* last)
+{
+    unique_lock<std::mutex> lock(mutex, defer_lock);
+    if (locking)
+    {
+        lock.lock();
+    }
+    last->left = freeList;
+    freeList = first;
+}
+
+//pushes a node on the free list. The key keeps its buffer so a reused node can often skip an allocation
+void AVLTree::NodePool::release(AVLNode* node)
+{
+    unique_lock<std::mutex> lock(mutex, defer_lock);
+    if (locking)
+    {
+        lock.lock();
+    }
+    node->right = nullptr;
+    node->left = freeList;
+    freeList = node;
+}
+
+//Iterator methods
+
+//an iterator with an empty path is end()
+AVLTree::const_iterator::const_iterator()
+{
+    root = nullptr;
+    depth = 0;
+}
+
+AVLTree::const_iterator::const_iterator(const const_iterator& other)
+{
+    *this = other;
+}
+
+AVLTree::const_iterator& AVLTree::const_iterator::operator=(const const_iterator& other)
+{
+    root = other.root;
+    depth = other.depth;
+    std::copy(other.path, other.path + other.depth, path);
+    return *this;
+}
+
+//returns the key and value of the current node
+AVLTree::const_iterator::reference AVLTree::const_iterator::operator*() const
+{
+    return {path[depth - 1]->key, path[depth - 1]->value};
+}
+
+const AVLTree::KeyType& AVLTree::const_iterator::key() const
+{
+    return path[depth - 1]->key;
+}
+
+const AVLTree::ValueType& AVLTree::const_iterator::value() const
+{
+    return path[depth - 1]->value;
+}
+
+//the next key is the smallest one in the right subtree if there is one.
+//Otherwise it is the first ancestor reached from a left child
+AVLTree::const_iterator& AVLTree::const_iterator::operator++()
+{
+    AVLNode* node = path[depth - 1];
+    if (node->right != nullptr)
+    {
+        descendLeft(node->right);
+        return *this;
+    }
+
+    AVLNode* child;
+    do
+    {
+        child = path[--depth];
+    } while (depth > 0 && path[depth - 1]->right == child);
+    return *this;
+}
+
+AVLTree::const_iterator AVLTree::const_iterator::operator++(int)
+{
+    const_iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+//mirror image of operator++. Stepping back from end() goes to the largest key
+AVLTree::const_iterator& AVLTree::const_iterator::operator--()
+{
+    if (depth == 0)
+    {
+        descendRight(root);
+        return *this;
+    }
+
+    AVLNode* node = path[depth - 1];
+    if (node->left != nullptr)
+    {
+        descendRight(node->left);
+        return *this;
+    }
+
+    AVLNode* child;
+    do
+    {
+        child = path[--depth];
+    } while (depth > 0 && path[depth - 1]->left == child);
+    return *this;
+}
+
+AVLTree::const_iterator AVLTree::const_iterator::operator--(int)
+{
+    const_iterator old = *this;
+    --(*this);
+    return old;
+}
+
+//two iterators are equal when they are on the same node, or both at end()
+bool AVLTree::const_iterator::operator==(const const_iterator& other) const
+{
+    if (depth == 0 || other.depth == 0)
+    {
+        return depth == other.depth;
+    }
+    return path[depth - 1] == other.path[other.depth - 1];
+}
+
+void AVLTree::const_iterator::descendLeft(AVLNode* node)
+{
+    while (node != nullptr)
+    {
+        path[depth++] = node;
+        node = node->left;
+    }
+}
+
+void AVLTree::const_iterator::descendRight(AVLNode* node)
+{
+    while (node != nullptr)
+    {
+        path[depth++] = node;
+        node = node->right;
+    }
+}
+
 //ostream methods
 
 //recursive method that puts all key-value pairs into an os stream object.
@@ -564,6 +2223,13 @@ void AVLTree::printTree(ostream& os, AVLNode* node) const
         return;
     }
 
+    size_t forks = parallelForks(node->subtreeSize);
+    if (forks > 0)
+    {
+        printTreeParallel(os, node, forks);
+        return;
+    }
+
     //In-Order traversal. Recursively calls the left branch and adds those key-value pairs to the ostream.
     //Then the current node is added to ostream, then the right branch is added to the ostream
     printTree(os, node->left);
@@ -573,6 +2239,70 @@ void AVLTree::printTree(ostream& os, AVLNode* node) const
     printTree(os, node->right);
 }
 
+//each batch has one piece per thread forks allows, so only that many formatted pieces are held at once
+void AVLTree::printTreeParallel(ostream& os, AVLNode* node, size_t forks) const
+{
+    vector<pair<AVLNode*, bool>> pieces;
+    collectPieces(node, pieces);
+
+    size_t batchSize = size_t(1) << forks;
+    vector<string> texts(batchSize);
+    vector<future<void>> running;
+    for (size_t start = 0; start < pieces.size(); start += batchSize)
+    {
+        size_t count = min(batchSize, pieces.size() - start);
+        for (size_t i = 0; i < count; i++)
+        {
+            auto [piece, wholeSubtree] = pieces[start + i];
+            texts[i].clear();
+            if (wholeSubtree)
+            {
+                running.push_back(async(launch::async, [this, piece, &text = texts[i]] { appendTree(piece, text); }));
+            }else
+            {
+                texts[i] += "{" + piece->key + ": " + to_string(piece->value) + "}\n";
+            }
+        }
+        for (future<void>& done : running)
+        {
+            done.get();
+        }
+        running.clear();
+        for (size_t i = 0; i < count; i++)
+        {
+            os << texts[i];
+        }
+    }
+}
+
+void AVLTree::collectPieces(AVLNode* node, vector<pair<AVLNode*, bool>>& pieces) const
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (node->subtreeSize <= parallelCutoff)
+    {
+        pieces.emplace_back(node, true);
+        return;
+    }
+    collectPieces(node->left, pieces);
+    pieces.emplace_back(node, false);
+    collectPieces(node->right, pieces);
+}
+
+//in-order, in the same format as printTree
+void AVLTree::appendTree(AVLNode* node, string& out) const
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    appendTree(node->left, out);
+    out += "{" + node->key + ": " + to_string(node->value) + "}\n";
+    appendTree(node->right, out);
+}
+
 //Overrides the << operator to allow for the whole tree to be output
 ostream& operator<<(std::ostream& os, const AVLTree& avlTree)
 {
@@ -4,24 +4,56 @@
 
 #ifndef AVLTREE_H
 #define AVLTREE_H
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 using namespace std;
 
+/**
+ *Lookups take std::string_view, so callers holding a view, a std::string or a
+ *string literal can search the tree without building a temporary std::string.
+ */
 class AVLTree {
 public:
     using KeyType = std::string;
     using ValueType = size_t;
 
+    class NodePool;
+    class const_iterator;
+    struct Stats;
+    struct HotCacheStats;
+
     /**
      *default constructor
      */
     AVLTree();
 
     /**
-     *copy constructor
+     *constructor that takes its nodes from the given pool.
+     *Trees that share a pool must be used from the same thread, so a pool per thread works as an arena.
+     */
+    explicit AVLTree(std::shared_ptr<NodePool> nodePool);
+
+    /**
+     *constructor that builds the tree from key-value pairs in linear time. See buildFromSorted
+     */
+    explicit AVLTree(std::vector<std::pair<KeyType, ValueType>> entries);
+
+    /**
+     *copy constructor. Takes O(1) time: the copy shares all nodes (and the node pool) with the original,
+     *and a later change to either tree copies only the nodes on the path it touches.
+     *A tree and its copies must be used from one thread at a time, since they share reference counts.
+     *References returned by operator[] on the original are invalidated, see operator[]
      */
     AVLTree(const AVLTree& other);
 
@@ -30,32 +62,125 @@ public:
     */
     bool insert(const std::string& key, size_t value);
 
+    /**
+    *Like insert, but moves the key into the new node. The key is left untouched if it is already in the tree
+    */
+    bool insert(KeyType&& key, ValueType value);
+
+    /**
+    *Inserts the key, or replaces its value if it is already in the tree, in a single descent.
+    *Returns true if the key was inserted and false if its value was replaced
+    */
+    bool insert_or_assign(const KeyType& key, ValueType value);
+    bool insert_or_assign(KeyType&& key, ValueType value);
+
+    /**
+    *Replaces the value of a key that is already in the tree, in a single descent. Returns false and leaves
+    *the contents unchanged if the key is missing, where operator[] would insert it
+    */
+    bool assign(std::string_view key, ValueType value);
+
+    /**
+    *Inserts the key with the given value if it is not in the tree, like insert. The key is only copied,
+    *or moved from, when a node is inserted. Returns false and leaves the tree unchanged otherwise
+    */
+    bool try_emplace(const KeyType& key, ValueType value = ValueType());
+    bool try_emplace(KeyType&& key, ValueType value = ValueType());
+
+    /**
+    *Replaces the contents of the tree with the given key-value pairs and builds a perfectly balanced tree
+    *in linear time, with all nodes taken from the pool in one allocation.
+    *Pairs that are not sorted by key are sorted first. For a duplicate key the first pair wins, like insert.
+    */
+    void buildFromSorted(std::vector<std::pair<KeyType, ValueType>> entries);
+
+    /**
+    *Inserts a batch of key-value pairs and returns how many were new. Keys already in the tree keep
+    *their values, and for a key repeated in the batch the first pair wins, like insert.
+    *A batch into an empty tree, or a large sorted batch, is merged with the tree and rebuilt in linear time.
+    *A tree that shares its root with a copy, or has a hot cache, is never rebuilt, so both are kept
+    */
+    size_t insertMany(std::span<const std::pair<KeyType, ValueType>> entries);
+
     /**
     *Removes a node from a tree if the key is in the tree. Rebalances after removal if necessary.
     */
-    bool remove(const KeyType& key);
+    bool remove(std::string_view key);
+
+    /**
+    *Splits the tree in O(log n). This tree keeps the keys below key, and the returned tree, which uses
+    *the same node pool, gets key and every key above it
+    */
+    AVLTree split(std::string_view key);
+
+    /**
+    *Removes every key between the two keys (inclusive) and returns how many were removed.
+    *The range is cut out with two splits and the rest joined back together, so it takes
+    *O(log n + k) time for k removed keys instead of k separate removes
+    */
+    size_t eraseRange(std::string_view lowKey, std::string_view highKey);
+
+    /**
+    *Adds every key of other that is not in this tree yet. For a key in both trees this tree's value is kept, like insertMany.
+    *The set operations split and join whole subtrees instead of inserting key by key, so they take
+    *O(m log(n/m + 1)) time for trees of m <= n keys, and large trees are divided between threads.
+    *other is not changed. When both trees use the same node pool, its untouched subtrees are shared, not copied
+    */
+    void unionWith(const AVLTree& other);
+
+    /**
+    *Keeps only the keys that are also in other, with this tree's values
+    */
+    void intersectWith(const AVLTree& other);
+
+    /**
+    *Removes every key that is in other
+    */
+    void differenceWith(const AVLTree& other);
+
+    /**
+    *Keeps only the key-value pairs for which predicate returns true and returns how many were removed.
+    *On a large tree the predicate is called from several threads at once, in no particular order
+    */
+    size_t filter(const std::function<bool(const KeyType&, const ValueType&)>& predicate);
 
 
     /**
     *Returns true if the tree does contain the method, and false if it does not.
+    *With a hot cache it writes to the cache, so it is not safe to call from several threads at once, see setHotCacheSize
     */
-    bool contains(const std::string& key) const;
+    bool contains(std::string_view key) const;
 
     /**
     *If the key is in the tree, then get will return the value assocaited with it.
+    *With a hot cache it writes to the cache, like contains
     */
-    optional<size_t> get(const std::string& key) const;
+    optional<size_t> get(std::string_view key) const;
 
 
     /**
-    *[] operator override that allows for individual values in the tree to be returned as a reference
+    *Looks up a batch of keys and returns their values in the same order, like calling get for each.
+    *Sorted keys are found with a finger search that starts each lookup from the previous one.
+    *Unsorted keys are searched several at a time, with the next nodes prefetched to hide memory latency
     */
-    size_t& operator[](const std::string& key);
+    std::vector<std::optional<ValueType>> getMany(std::span<const std::string_view> keys) const;
+    std::vector<std::optional<ValueType>> getMany(std::span<const KeyType> keys) const;
+
+    /**
+    *[] operator override that allows for individual values in the tree to be returned as a reference.
+    *A missing key is inserted with a value of 0 first, so a read-modify-write takes a single descent.
+    *The reference stays valid until the tree is next changed, copied or assigned to another tree. A copy shares
+    *the node, so a write through a reference taken before it would show in the copy too: take it again instead
+    */
+    size_t& operator[](std::string_view key);
+    size_t& operator[](KeyType&& key);
+    //a string literal would otherwise match both of the overloads above
+    size_t& operator[](const char* key);
 
     /**
     *Returns a vector that returns all keys between two ranges.
     */
-    vector<size_t> findRange(const std::string& lowKey, const std::string& highKey) const;
+    vector<size_t> findRange(std::string_view lowKey, std::string_view highKey) const;
 
 
     /**
@@ -63,6 +188,109 @@ public:
     */
     std::vector<std::string> keys() const;
 
+    /**
+    *Iterators over the key-value pairs in key order. Any change to the tree invalidates them
+    */
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    /**
+    *Returns an iterator to the first key that is not less than the given key, or end()
+    */
+    const_iterator lower_bound(std::string_view key) const;
+
+    /**
+    *Returns an iterator to the first key that is greater than the given key, or end()
+    */
+    const_iterator upper_bound(std::string_view key) const;
+
+    /**
+    *Returns the lower_bound and upper_bound of a key, which surround the key's entry if it is in the tree
+    */
+    std::pair<const_iterator, const_iterator> equal_range(std::string_view key) const;
+
+    /**
+    *Returns how many keys in the tree are less than the given key, in O(log n)
+    */
+    size_t rank(std::string_view key) const;
+
+    /**
+    *Returns an iterator to the key at the given position in key order (0 is the smallest), or end()
+    */
+    const_iterator select(size_t index) const;
+
+    /**
+    *Returns how many keys lie between the two keys (inclusive), like findRange(...).size() but in O(log n)
+    */
+    size_t countRange(std::string_view lowKey, std::string_view highKey) const;
+
+    /**
+    *Returns the instrumentation counters. They are only collected when the tree is built with
+    *AVLTREE_STATS defined (the AVLTREE_STATS CMake option); otherwise every counter is zero
+    */
+    Stats stats() const;
+
+    /**
+    *Sets all instrumentation counters, and the hot cache's hit and miss counts, back to zero
+    */
+    void resetStats();
+
+    /**
+    *Puts a cache of recently found keys in front of get and contains, with room for the given number of keys
+    *rounded up to a power of two. 0 removes it, which is the default. A lookup that hits hashes the key and
+    *compares it once instead of descending the tree, which pays off when a few keys get most of the lookups.
+    *Every change that can move or free a node, such as remove or an insert into a tree shared with a copy,
+    *empties the cache in O(1). Changing a value, through operator[] or insert_or_assign, keeps it.
+    *With a cache, get and contains write to the tree even though they are const, so a tree that has one must
+    *not be read from several threads at once. Readers of ConcurrentAVLTree and LockFreeAVLTree do that, so
+    *the cache must not be turned on through their write. Copies of the tree get a cache of the same size,
+    *which takes no memory until their first lookup, so copying stays O(1)
+    */
+    void setHotCacheSize(size_t slots);
+
+    /**
+    *Returns the cache's size and how many lookups hit or missed it since it was sized or resetStats was called
+    */
+    HotCacheStats hotCacheStats() const;
+
+    /**
+    *Sets the smallest subtree, in nodes, that the set operations, copy, clear, keys and operator<< hand
+    *to another thread. Smaller values use more threads on smaller trees; SIZE_MAX keeps everything on
+    *the calling thread. Copies of the tree, and the upper tree split returns, start with the same cutoff
+    */
+    void setParallelCutoff(size_t nodes);
+    size_t getParallelCutoff() const;
+
+    /**
+    *Turns relaxed balancing on or off. In relaxed mode insert and remove keep heights and sizes up to date but
+    *skip the rotations, so a burst of writes does not wait for rebalancing. Nodes left out of AVL balance are
+    *marked for rebalance, and a node is only rotated at once when its subtrees' heights would differ by more
+    *than RELAXED_BALANCE_SLACK, which keeps the height below about 1.81 * log2(n).
+    *split, eraseRange and the set operations rebalance the trees they work on first.
+    *Turning relaxed mode off rebalances the whole tree. Copies of the tree start in the same mode
+    */
+    void setRelaxedBalance(bool relaxed);
+    bool isRelaxedBalance() const;
+
+    /**
+    *Restores AVL balance to the subtrees relaxed mode left out of it, working from the bottom up and stopping
+    *after about budget nodes. A subtree that shrank so much that its parent would pass the slack is finished even
+    *past the budget. Returns true if the whole tree is in AVL balance afterwards
+    */
+    bool rebalance(size_t budget = SIZE_MAX);
+
+    /**
+    *Writes the key-value pairs to a binary snapshot file in key order (the format is described in AVLTreeFormat.h).
+    *Returns false if the file could not be written or a key is longer than 4 GiB
+    */
+    bool save(const std::string& path) const;
+
+    /**
+    *Replaces the contents of the tree with a snapshot written by save, rebuilding it in linear time.
+    *Returns false, and leaves the tree unchanged, if the file is missing, truncated, fails its checksum or has another version
+    */
+    bool load(const std::string& path);
+
     /**
     *returns the number of key value pairs in the tree
     */
@@ -73,10 +301,18 @@ public:
     */
     size_t getHeight() const;
 
+    /**
+    *Checks the whole tree in O(n), for tests: keys in order, and every node's height and subtree size.
+    *In AVL balance no node's subtrees differ in height by more than 1 and no node is marked for rebalance.
+    *In relaxed balance they differ by at most RELAXED_BALANCE_SLACK, every node past 1 is marked, and so are
+    *all the nodes above a marked one
+    */
+    bool isValid() const;
+
 
     /**.
-    *= operator overload. Creates a deep copy of another tree and puts it into the tree that called it.
-    * Deletes memory that is no longer being used after the assignment.
+    *= operator overload. Releases the current nodes and shares the other tree's nodes, like the copy constructor.
+    *References returned by operator[] on either tree are invalidated
     */
     void operator=(const AVLTree& other);
 
@@ -90,15 +326,39 @@ public:
 
 
 protected:
-    class AVLNode {
-    public:
-        KeyType key;
-        ValueType value;
-        size_t height;
+    //upper bound on the depth of any tree that fits in memory. A tree of at most 2^32 nodes is at most 44 levels
+    //deep in AVL balance and 56 in relaxed balance, where subtree heights can differ by up to RELAXED_BALANCE_SLACK
+    static constexpr size_t MAX_HEIGHT = 96;
+    //largest value the 23-bit reference count can hold
+    static constexpr uint32_t MAX_REF_COUNT = (1u << 23) - 1;
+    //how far apart the heights of a node's subtrees may drift in relaxed balance mode before it is fixed at once
+    static constexpr int RELAXED_BALANCE_SLACK = 2;
+    //default for setParallelCutoff
+    static constexpr size_t DEFAULT_PARALLEL_CUTOFF = 1 << 14;
 
+    /**
+     *Nodes are aligned to a cache line so a node never straddles two lines.
+     *The child pointers come first because every step of a descent reads them,
+     *and short keys are stored inside the std::string itself, on the same line.
+     */
+    class alignas(64) AVLNode {
+    public:
         AVLNode* left;
         AVLNode* right;
 
+        KeyType key;
+        ValueType value;
+        // an AVL tree of 2^64 nodes is less than 100 levels deep, so 8 bits are enough
+        uint32_t height : 8;
+        // set in relaxed balance mode when this node or one below it may be out of AVL balance
+        uint32_t dirty : 1;
+        // number of trees and parent nodes pointing at this node. Copies of a tree share nodes,
+        // and a node is only changed in place while this is 1
+        uint32_t refCount : 23;
+        // number of nodes in the subtree rooted here, for rank and select.
+        // It fits in the padding at the end of the cache line, which limits a tree to 2^32 nodes
+        uint32_t subtreeSize;
+
         // 0, 1 or 2
         size_t numChildren() const;
         // true or false
@@ -110,16 +370,203 @@ protected:
     };
 
 public:
+    /**
+     *Slab allocator for tree nodes. Nodes are carved out of large slabs and recycled
+     *through a free list, and all slabs are released together when the pool is destroyed.
+     */
+    class NodePool {
+    public:
+        explicit NodePool(size_t nodesPerSlab = 1024);
+
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        //number of nodes that have been carved out of the slabs, in use or on the free list
+        size_t capacity() const;
+
+    private:
+        friend class AVLTree;
+
+        //takes a node from the free list, or from the current slab if the free list is empty
+        AVLNode* allocate();
+        //hands out count contiguous nodes in a slab of their own
+        AVLNode* allocateBlock(size_t count);
+        //puts a node on the free list so the next allocate can reuse it
+        void release(AVLNode* node);
+        //puts a chain of nodes, linked through their left pointers from first to last, on the free list at once
+        void releaseChain(AVLNode* first, AVLNode* last);
+
+        //set while a parallel operation runs, so the three functions above take the mutex.
+        //It is only changed while no other thread uses the pool
+        bool locking;
+        std::mutex mutex;
+
+        std::vector<std::unique_ptr<AVLNode[]>> slabs;
+        size_t nodesPerSlab;
+        //unused part of the slab that allocate() is currently carving from
+        AVLNode* slabNext;
+        AVLNode* slabEnd;
+        //number of nodes handed out from all slabs
+        size_t nodesCarved;
+        //recycled nodes, chained through their left pointer
+        AVLNode* freeList;
+    };
+
+    /**
+     *Bidirectional iterator that walks the tree in key order without recursion.
+     *It keeps the path from the root to its node, so each step is O(1) amortized
+     *and no parent pointers are needed in the nodes. end() has an empty path.
+     */
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<const KeyType&, const ValueType&>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+        using pointer = void;
+
+        const_iterator();
+        //copies only the used part of the path
+        const_iterator(const const_iterator& other);
+        const_iterator& operator=(const const_iterator& other);
+
+        //the key-value pair the iterator is on
+        reference operator*() const;
+        const KeyType& key() const;
+        const ValueType& value() const;
+
+        //moves to the next or previous key
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+        bool operator==(const const_iterator& other) const;
+
+    private:
+        friend class AVLTree;
+
+        //the root of the tree, needed to step back from end()
+        AVLNode* root;
+        //nodes from the root down to the current node
+        AVLNode* path[MAX_HEIGHT];
+        size_t depth;
 
+        //pushes node and then its left children (or right children) down to the smallest (or largest) key
+        void descendLeft(AVLNode* node);
+        void descendRight(AVLNode* node);
+    };
 
+    /**
+     *Counters for profiling. Counting adds work to every descent and the counters are not
+     *synchronized, so AVLTREE_STATS builds are meant for single-threaded measurement
+     */
+    struct Stats {
+        //key comparisons made by searches, inserts, removes and range scans
+        uint64_t comparisons = 0;
+        //nodes looked at on the way down, including the walk to a removed node's successor
+        uint64_t nodeVisits = 0;
+        uint64_t singleRotations = 0;
+        uint64_t doubleRotations = 0;
+        //nodes taken from the pool, including copies made for copy-on-write
+        uint64_t allocations = 0;
+        //searchDepth[d] counts get/contains lookups that ended after passing d nodes
+        uint64_t searchDepth[MAX_HEIGHT + 1] = {};
+    };
 
+    /**
+     *Counters of the hot-key cache. Unlike Stats they are always collected
+     */
+    struct HotCacheStats {
+        //number of keys the cache can hold, 0 if there is no cache
+        size_t slots = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
 
     private:
+    /**
+     *Direct-mapped cache of key hashes to nodes. A slot is valid only while its version equals the
+     *cache's, so invalidating every slot at once is a single increment
+     */
+    struct HotCache {
+        struct Slot {
+            AVLNode* node = nullptr;
+            uint64_t version = 0;
+        };
+        //the size the cache was given. slots stays empty until the first lookup
+        size_t slotCount = 0;
+        std::vector<Slot> slots;
+        //starts at 1, so the zeroed slots are invalid
+        uint64_t version = 1;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
     AVLNode* root;
     size_t treeSize;
+    std::shared_ptr<NodePool> pool;
+    size_t parallelCutoff;
+    bool relaxedBalance;
+    //null unless setHotCacheSize turned the cache on
+    std::unique_ptr<HotCache> hotCache;
+#ifdef AVLTREE_STATS
+    mutable Stats statistics;
+#endif
 
-    //insert helper method
-    bool insertRecursive(AVLNode*& node, const KeyType& key, ValueType value);
+    /**
+     *helper method for every single-key insert and for operator[]. Returns the node with the given key,
+     *inserting it with the given value if it is missing, and sets inserted accordingly. The node and its
+     *ancestors belong only to this tree, so the caller may change the value without affecting copies.
+     *A new node's key is moved from *movableKey if that is not null, and copied from key otherwise
+     */
+    AVLNode* findOrInsert(std::string_view key, KeyType* movableKey, ValueType value, bool& inserted);
+
+    /**
+     *findNode for get and contains, answered from the hot cache when it can be. A found node is put in the cache
+     */
+    AVLNode* findCachedNode(std::string_view key) const;
+
+    /**
+     *Empties the hot cache. Called by every change that may free a node, or replace it with a copy
+     */
+    void invalidateHotCache();
+
+    /**
+     *Balances the nodes on a recorded path of slots from the bottom up, stopping at the first
+     *subtree whose height did not change. The nodes above that only get sizeChange added to their size
+     */
+    void rebalancePath(AVLNode** path[], size_t depth, int sizeChange);
+
+    /**
+     *rebalancePath for relaxed mode. Updates heights and sizes and marks nodes that drift out of AVL balance,
+     *and only rotates a node that would pass RELAXED_BALANCE_SLACK
+     */
+    void relaxPath(AVLNode** path[], size_t depth, int sizeChange);
+
+    /**
+     *Brings a node one past RELAXED_BALANCE_SLACK back within it with a single or double rotation,
+     *and marks the rotated nodes from their new children
+     */
+    void restoreSlack(AVLNode*& node);
+    void markIfUnbalanced(AVLNode* node) const;
+
+    /**
+     *recursive helper for rebalance. Brings both subtrees of a marked node into AVL balance, then joins the node
+     *back between them. Returns false, with the node still marked, if the budget ran out first
+     */
+    bool rebalanceSubtree(AVLNode*& node, size_t& budget);
+
+    /**
+     *true if relaxed mode left some node out of AVL balance
+     */
+    bool hasDirtyNodes() const;
+
+    /**
+     *recursive helper for isValid. Checks the subtree under node, whose keys must lie strictly between low and high
+     *where those are given, and whose nodes may only be marked if markAllowed is set
+     */
+    bool isValidSubtree(AVLNode* node, const KeyType* low, const KeyType* high, bool markAllowed) const;
 
 
     //Tree balancing methods
@@ -129,9 +576,14 @@ public:
     static int getHeight(AVLNode* node);
 
     /**
-     *Recursive helper method that updates a node's height based on chlildren's heights
+     *helper method that gets the number of nodes in a subtree and handles null pointers
+     */
+    static size_t getSize(AVLNode* node);
+
+    /**
+     *helper method that updates a node's height and subtree size based on chlildren's values
      */
-    void updateHeight(AVLNode*);
+    void updateNode(AVLNode*);
 
     /**
      *Calculates the balance factor of a node
@@ -152,52 +604,185 @@ public:
 
 
     /* Helper methods for remove */
-    // this overloaded remove will do the recursion to remove the node
-    bool remove(AVLNode*& current, KeyType key);
-    // removeNode contains the logic for actually removing a node based on the numebr of children
-    bool removeNode(AVLNode*& current);
+    // this overloaded remove will walk down from current to find and remove the node
+    bool remove(AVLNode*& current, std::string_view key);
+    // removeNode contains the logic for actually removing a node based on the numebr of children.
+    // Nodes whose height may change are appended to path
+    bool removeNode(AVLNode*& current, AVLNode** path[], size_t& depth);
     // You will implement this, but it is needed for removeNode()
     void balanceNode(AVLNode*& node);
 
 
-    bool containsRecursive(AVLNode* node, const string& key) const;
+    /* Join-based helpers for the set operations. Every node pointer passed in carries one reference that the
+       helper takes over, and every node pointer returned carries one reference for the caller */
+    /**
+     *Links two subtrees and a node into one balanced subtree. Every key in left must be below middle's key,
+     *and every key in right above it. middle must belong only to this tree; its old children are ignored.
+     *When the heights differ by more than one, the shorter subtree is joined into the taller one's spine at
+     *the first node of about its height, and the nodes above are rebalanced with balanceNode
+     */
+    AVLNode* join(AVLNode* left, AVLNode* middle, AVLNode* right);
+
+    /**
+     *Links two subtrees, where every key in left is below every key in right, by taking out left's largest node
+     *as the middle node
+     */
+    AVLNode* join(AVLNode* left, AVLNode* right);
+
+    /**
+     *Takes the node with the largest key out of a subtree. Returns the rest, rebalanced, and sets last to the node
+     */
+    AVLNode* splitLast(AVLNode* node, AVLNode*& last);
+
+    /**
+     *Splits a subtree into the keys below key and the keys above it. Returns the node with the key, whose child
+     *pointers no longer mean anything, or null if the key is not in the subtree
+     */
+    AVLNode* split(AVLNode* node, std::string_view key, AVLNode*& left, AVLNode*& right);
+
+    /**
+     *Recursive bodies of the set operations. Both subtrees are consumed. forks is how many more levels of the
+     *recursion may run their halves on two threads
+     */
+    AVLNode* unionNodes(AVLNode* mine, AVLNode* theirs, size_t forks);
+    AVLNode* intersectNodes(AVLNode* mine, AVLNode* theirs, size_t forks);
+    AVLNode* differenceNodes(AVLNode* mine, AVLNode* theirs, size_t forks);
+    AVLNode* filterNodes(AVLNode* node, const std::function<bool(const KeyType&, const ValueType&)>& predicate, size_t forks);
+
+    /**
+     *Number of recursion levels that may fork for an operation over the given number of nodes,
+     *or 0 if it should run on the calling thread alone
+     */
+    size_t parallelForks(size_t nodes) const;
+
+    /**
+     *Runs two halves of a divide-and-conquer step, the first one on another thread if forks is not
+     *zero and the first half has at least parallelCutoff nodes of work. The set operations count the
+     *smaller of their two inputs, since a small tree merged into a large one takes little work
+     */
+    template <class First, class Second>
+    void forkJoin(size_t forks, size_t nodes, First first, Second second) const;
+
+    /**
+     *three-way comparison of a search key with a node's key, used by every descent
+     */
+    int compareKey(std::string_view key, const KeyType& nodeKey) const;
+
+    /**
+     *Lengths of the prefixes the search key shares with the nearest smaller and larger node keys
+     *passed on the way down. Every key in the subtree below lies between those two keys, so it shares
+     *at least the shorter of the two prefixes with the search key, and a comparison can skip it.
+     *Keys with a long common prefix, like "tenant/region/host/metric", then cost one pass over their bytes per descent
+     */
+    struct PrefixBounds {
+        size_t low = 0;
+        size_t high = 0;
+    };
+
+    /**
+     *Like compareKey, but starts after the prefix the bounds guarantee to be equal and narrows the
+     *bounds with the result. Used by the single-key descents. The prefix is only skipped when the tree
+     *is built with AVLTREE_PREFIX_BOUNDS (the AVLTREE_PREFIX_BOUNDS CMake option); otherwise this is compareKey.
+     *The option is off by default because the bookkeeping costs more than the bytes it skips for the keys
+     *avltree_bench measures, short or hierarchical. It is meant for keys with much longer shared prefixes
+     */
+    int compareKey(std::string_view key, const KeyType& nodeKey, PrefixBounds& bounds) const;
 
     /**
-         *Recursive helper method for get that will search the tree recursively for a key and return the associated value if found.
-         */
-    optional<size_t> getRecursive(AVLNode* node, const KeyType& key) const;
+     *helper method for get and contains that walks down the tree to the node with the given key.
+     *Returns null if the key is not in the tree
+     */
+    AVLNode* findNode(std::string_view key) const;
 
     /**
-    *Recursive findRange helper method the performs in-order traversal to find all keys
+     *helper method for lower_bound and upper_bound. Returns an iterator to the first key that is
+     *greater than the given key, or greater than or equal to it when inclusive is true
      */
-    void findRangeRecursive(AVLNode* node, const KeyType& lowKey, const KeyType& highKey, vector<size_t>& result) const;
+    const_iterator seek(std::string_view key, bool inclusive) const;
 
     /**
-     *Recursive helper method that returns a reference to a value in a node
+     *helper method for rank and countRange. Counts the keys less than the given key,
+     *or less than or equal to it when inclusive is true
      */
-    AVLNode& bracketRecursive(AVLNode*& node, const std::string& key);
+    size_t countBelow(std::string_view key, bool inclusive) const;
 
     /**
-     *recursive method to clear a tree upon deletion and release memeory
+     *helpers for getMany. Both work on any span of keys that convert to std::string_view
+     */
+    template <class Key>
+    std::vector<std::optional<ValueType>> getManyKeys(std::span<const Key> keys) const;
+    template <class Key>
+    void getManySorted(std::span<const Key> keys, std::vector<std::optional<ValueType>>& results) const;
+    template <class Key>
+    void getManyInterleaved(std::span<const Key> keys, std::vector<std::optional<ValueType>>& results) const;
+
+    /**
+     *recursive method to clear a tree upon deletion. Drops the tree's reference to each node and
+     *returns the nodes no other tree uses to the pool. A large subtree is walked by several threads
      */
     void clear(AVLNode*& node);
 
     /**
-     *Recursive helper for copying data from one tree to another
+     *Parallel walk for clear. Drops the references like clear, but links the nodes to be released into
+     *a chain from first to last instead of touching the pool, so each thread builds its own chain
+     */
+    void collectUnused(AVLNode* node, AVLNode*& first, AVLNode*& last, size_t forks);
+
+    /**
+     *Recursive helper for buildFromSorted. Links entries [begin, end) into a balanced subtree,
+     *using block[i] as the node for entries[i], and returns the subtree's root
+     */
+    AVLNode* buildBalanced(std::vector<std::pair<KeyType, ValueType>>& entries, size_t begin, size_t end, AVLNode* block);
+
+    /**
+     *Adds a reference to a node that another tree or parent is going to point at.
+     *If the count is already at its limit, a deep copy of the subtree is returned instead
+     */
+    AVLNode* shareNode(AVLNode* node) const;
+
+    /**
+     *Makes sure the node in a slot belongs only to this tree so it can be changed in place.
+     *A shared node is replaced in the slot by a copy that shares the node's children.
+     *Returns the node now in the slot
+     */
+    AVLNode* mutableNode(AVLNode*& slot);
+
+    /**
+     *Recursive helper for copying data from one tree to another. A large subtree is copied by several threads
      */
     AVLNode* copy(const AVLNode* node) const;
 
+    /**
+     *Parallel copy. The copy of the node with in-order position i in the subtree goes to block[i],
+     *so threads copying different subtrees fill disjoint parts of the block without touching the pool
+     */
+    AVLNode* copyInto(const AVLNode* node, AVLNode* block, size_t forks) const;
+
     /**
      *Recursive helper method for the keys function
-     *Performs an in-order search for the keys
+     *Performs an in-order search for the keys. The key with in-order position i in the subtree is written
+     *to out[i], so subtrees can be handled by different threads
      */
-    void keysRecursive(AVLNode* node, vector<string>& result) const;
+    void keysRecursive(AVLNode* node, std::string* out, size_t forks) const;
 
     /**
     *recursive method to get all data key value pairs in a tree and appends them to an os object to be output
     */
     void printTree(ostream& os, AVLNode* node) const;
 
+    /**
+     *Parallel printTree. Cuts the tree into subtrees of at most parallelCutoff nodes and the nodes between
+     *them, formats a batch of pieces on several threads and writes the batch in order
+     */
+    void printTreeParallel(ostream& os, AVLNode* node, size_t forks) const;
+
+    /**
+     *helpers for printTreeParallel. collectPieces lists the pieces in key order, each with whether it
+     *stands for its whole subtree or just the node. appendTree formats a subtree the way printTree does
+     */
+    void collectPieces(AVLNode* node, std::vector<std::pair<AVLNode*, bool>>& pieces) const;
+    void appendTree(AVLNode* node, std::string& out) const;
+
     /**
     *Outputs all nodes in the AVL tree in the format "{Key: value}"
     */
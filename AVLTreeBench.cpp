@@ -0,0 +1,562 @@
+/*
+Microbenchmark suite for AVLTree, with std::map and std::unordered_map as baselines.
+
+For every container, key workload and size it measures insert, get, findRange, remove and copy,
+and reports throughput, sampled latency percentiles and the heap bytes used per entry.
+Built with AVLTREE_STATS, AVLTree results also show key comparisons and rotations per operation.
+
+Workloads (the order keys are inserted and looked up in):
+  sequential  ascending keys, the adversarial case for an unbalanced tree
+  reverse     descending keys
+  random      uniformly shuffled keys
+  zipfian     random inserts, lookups skewed towards a few hot keys (theta = 0.99)
+
+Containers:
+  avltree, avltree_cached (AVLTree with a 4096-key hot cache),
+  avltree_relaxed (AVLTree in relaxed balance mode), avltree_compact (CompactAVLTree), btree (BTree), map,
+  unordered_map
+
+Keys:
+  short         "key/0000000042", short enough to be stored inside std::string
+  hierarchical  "tenant-000/region-00/host-00042/metric/cpu.user.seconds", long keys with shared prefixes
+
+usage: avltree_bench [--sizes 1000,10000,...] [--workloads random,zipfian,...]
+                     [--containers avltree,avltree_cached,avltree_relaxed,avltree_compact,btree,map,unordered_map] [--keys short|hierarchical] [--json]
+ */
+#include "AVLTree.h"
+#include "BTree.h"
+#include "CompactAVLTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+//Heap accounting. Every allocation goes through these, so bytes per entry can be measured the same way
+//for every container
+
+static size_t liveHeapBytes = 0;
+
+void* operator new(size_t size)
+{
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    liveHeapBytes += malloc_usable_size(memory);
+    return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment)
+{
+    void* memory = aligned_alloc(static_cast<size_t>(alignment), (size + static_cast<size_t>(alignment) - 1) & ~(static_cast<size_t>(alignment) - 1));
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    liveHeapBytes += malloc_usable_size(memory);
+    return memory;
+}
+
+//Every operator delete frees through here. Kept out of line because GCC otherwise inlines operator new and
+//operator delete into one caller, sees free given memory from operator new, and warns of a mismatch
+[[gnu::noinline]] static void releaseHeap(void* memory) noexcept
+{
+    if (memory != nullptr)
+    {
+        liveHeapBytes -= malloc_usable_size(memory);
+        free(memory);
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    releaseHeap(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    releaseHeap(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept
+{
+    releaseHeap(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept
+{
+    releaseHeap(memory);
+}
+
+//Containers under test. Each adapter exposes the same small interface so the workloads are written once
+
+struct AVLTreeAdapter {
+    static constexpr const char* name = "avltree";
+    static constexpr bool ordered = true;
+    AVLTree tree;
+
+    bool insert(const string& key, size_t value) { return tree.insert(key, value); }
+    bool get(const string& key) const { return tree.get(key).has_value(); }
+    size_t range(const string& low, const string& high) const { return tree.findRange(low, high).size(); }
+    bool remove(const string& key) { return tree.remove(key); }
+    size_t size() const { return tree.size(); }
+
+    //comparisons and rotations so far, and a way to reset them before each phase
+    uint64_t comparisons() const { return tree.stats().comparisons; }
+    uint64_t rotations() const { return tree.stats().singleRotations + tree.stats().doubleRotations; }
+    void resetStats() { tree.resetStats(); }
+};
+
+//the same tree with the hot-key cache in front of get
+struct CachedAVLTreeAdapter : AVLTreeAdapter {
+    static constexpr const char* name = "avltree_cached";
+
+    CachedAVLTreeAdapter() { tree.setHotCacheSize(4096); }
+};
+
+//the same tree in relaxed balance mode and never rebalanced, to show what skipping rotations saves on writes
+//and costs on lookups
+struct RelaxedAVLTreeAdapter : AVLTreeAdapter {
+    static constexpr const char* name = "avltree_relaxed";
+
+    RelaxedAVLTreeAdapter() { tree.setRelaxedBalance(true); }
+};
+
+//AVLTree's balancing over 32-byte array nodes with the key prefix inline
+struct CompactAVLTreeAdapter {
+    static constexpr const char* name = "avltree_compact";
+    static constexpr bool ordered = true;
+    CompactAVLTree tree;
+
+    bool insert(const string& key, size_t value) { return tree.insert(key, value); }
+    bool get(const string& key) const { return tree.get(key).has_value(); }
+    size_t range(const string& low, const string& high) const { return tree.findRange(low, high).size(); }
+    bool remove(const string& key) { return tree.remove(key); }
+    size_t size() const { return tree.size(); }
+};
+
+//the wide-node sibling of AVLTree, with the same interface
+struct BTreeAdapter {
+    static constexpr const char* name = "btree";
+    static constexpr bool ordered = true;
+    BTree tree;
+
+    bool insert(const string& key, size_t value) { return tree.insert(key, value); }
+    bool get(const string& key) const { return tree.get(key).has_value(); }
+    size_t range(const string& low, const string& high) const { return tree.findRange(low, high).size(); }
+    bool remove(const string& key) { return tree.remove(key); }
+    size_t size() const { return tree.size(); }
+};
+
+struct MapAdapter {
+    static constexpr const char* name = "map";
+    static constexpr bool ordered = true;
+    map<string, size_t> tree;
+
+    bool insert(const string& key, size_t value) { return tree.emplace(key, value).second; }
+    bool get(const string& key) const { return tree.find(key) != tree.end(); }
+    size_t range(const string& low, const string& high) const
+    {
+        vector<size_t> values;
+        for (auto it = tree.lower_bound(low); it != tree.end() && it->first <= high; ++it)
+        {
+            values.push_back(it->second);
+        }
+        return values.size();
+    }
+    bool remove(const string& key) { return tree.erase(key) == 1; }
+    size_t size() const { return tree.size(); }
+};
+
+struct UnorderedMapAdapter {
+    static constexpr const char* name = "unordered_map";
+    static constexpr bool ordered = false;
+    unordered_map<string, size_t> tree;
+
+    bool insert(const string& key, size_t value) { return tree.emplace(key, value).second; }
+    bool get(const string& key) const { return tree.find(key) != tree.end(); }
+    size_t range(const string&, const string&) const { return 0; }
+    bool remove(const string& key) { return tree.erase(key) == 1; }
+    size_t size() const { return tree.size(); }
+};
+
+//Key generation
+
+//fixed-width keys so string order matches numeric order
+static string makeKey(size_t i, bool hierarchical)
+{
+    char buffer[96];
+    if (hierarchical)
+    {
+        snprintf(buffer, sizeof(buffer), "tenant-%03zu/region-%02zu/host-%05zu/metric/cpu.user.seconds",
+                 i / 10000000, i / 100000 % 100, i % 100000);
+    }else
+    {
+        snprintf(buffer, sizeof(buffer), "key/%010zu", i);
+    }
+    return buffer;
+}
+
+//Zipfian ranks in [0, n) using the method from Gray et al., "Quickly Generating Billion-Record
+//Synthetic Databases". Setup is O(n) once, each sample is O(1)
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(size_t n, double theta) : n(n), theta(theta)
+    {
+        for (size_t i = 1; i <= n; i++)
+        {
+            zetaN += 1.0 / pow(static_cast<double>(i), theta);
+        }
+        double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetaN);
+    }
+
+    size_t operator()(mt19937_64& rng)
+    {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetaN;
+        if (uz < 1.0)
+        {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, theta))
+        {
+            return 1;
+        }
+        return min(n - 1, static_cast<size_t>(n * pow(eta * u - eta + 1.0, alpha)));
+    }
+
+private:
+    size_t n;
+    double theta;
+    double zetaN = 0.0;
+    double alpha;
+    double eta;
+};
+
+//the key indexes used for inserting and for looking up, in the order the workload uses them
+struct Workload {
+    string name;
+    vector<size_t> insertOrder;
+    vector<size_t> lookupOrder;
+};
+
+static Workload makeWorkload(const string& name, size_t n)
+{
+    Workload workload{name, vector<size_t>(n), vector<size_t>(n)};
+    mt19937_64 rng(42);
+    for (size_t i = 0; i < n; i++)
+    {
+        workload.insertOrder[i] = i;
+    }
+
+    if (name == "reverse")
+    {
+        reverse(workload.insertOrder.begin(), workload.insertOrder.end());
+    }
+    else if (name == "random" || name == "zipfian")
+    {
+        shuffle(workload.insertOrder.begin(), workload.insertOrder.end(), rng);
+    }
+
+    if (name == "zipfian")
+    {
+        //hot ranks are scattered over the key space so they do not all sit in one subtree
+        ZipfianGenerator zipf(n, 0.99);
+        for (size_t i = 0; i < n; i++)
+        {
+            workload.lookupOrder[i] = (zipf(rng) * 0x9E3779B97F4A7C15ull) % n;
+        }
+    }
+    else if (name == "random")
+    {
+        workload.lookupOrder = workload.insertOrder;
+        shuffle(workload.lookupOrder.begin(), workload.lookupOrder.end(), rng);
+    }else
+    {
+        workload.lookupOrder = workload.insertOrder;
+    }
+    return workload;
+}
+
+//Measurement
+
+struct Result {
+    string container;
+    string workload;
+    size_t size;
+    string operation;
+    size_t ops;
+    double opsPerSecond;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double bytesPerEntry;
+    //only known for AVLTree built with AVLTREE_STATS, otherwise 0
+    double comparisonsPerOp;
+    double rotationsPerOp;
+};
+
+//runs op(i) for i in [0, count). Every op is counted for throughput, and about 100000 of them are
+//timed one by one for the latency percentiles, so the timer overhead stays out of the throughput number
+template <class Operation>
+static Result measure(size_t count, Operation op)
+{
+    size_t sampleEvery = max<size_t>(1, count / 100000);
+    vector<double> samples;
+    samples.reserve(count / sampleEvery + 1);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % sampleEvery == 0)
+        {
+            auto before = chrono::steady_clock::now();
+            op(i);
+            samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - before).count());
+        }else
+        {
+            op(i);
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Result result{};
+    result.ops = count;
+    result.opsPerSecond = seconds > 0 ? count / seconds : 0;
+    if (!samples.empty())
+    {
+        sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) { return samples[min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+        result.p50 = percentile(0.50);
+        result.p90 = percentile(0.90);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+    }
+    return result;
+}
+
+//keeps lookups from being optimized away
+static size_t sink = 0;
+
+template <class Container>
+static void runContainer(const Workload& workload, const vector<string>& keys, vector<Result>& results)
+{
+    size_t n = keys.size();
+    size_t heapBefore = liveHeapBytes;
+    auto container = make_unique<Container>();
+
+    //each phase starts with fresh counters, so the ones read here belong to that phase
+    auto record = [&](const string& operation, Result result, double bytesPerEntry) {
+        result.container = Container::name;
+        result.workload = workload.name;
+        result.size = n;
+        result.operation = operation;
+        result.bytesPerEntry = bytesPerEntry;
+        if constexpr (requires { container->comparisons(); })
+        {
+            result.comparisonsPerOp = static_cast<double>(container->comparisons()) / result.ops;
+            result.rotationsPerOp = static_cast<double>(container->rotations()) / result.ops;
+            container->resetStats();
+        }
+        results.push_back(result);
+    };
+
+    Result insertResult = measure(n, [&](size_t i) {
+        size_t index = workload.insertOrder[i];
+        sink += container->insert(keys[index], index);
+    });
+    double bytesPerEntry = n > 0 ? static_cast<double>(liveHeapBytes - heapBefore) / n : 0;
+    record("insert", insertResult, bytesPerEntry);
+
+    record("get", measure(n, [&](size_t i) {
+        sink += container->get(keys[workload.lookupOrder[i]]);
+    }), bytesPerEntry);
+
+    //ranges of about 100 keys starting at each lookup key
+    if (Container::ordered)
+    {
+        size_t rangeCount = max<size_t>(1, n / 100);
+        record("findRange", measure(rangeCount, [&](size_t i) {
+            size_t low = workload.lookupOrder[i];
+            size_t high = min(n - 1, low + 99);
+            sink += container->range(keys[low], keys[high]);
+        }), bytesPerEntry);
+    }
+
+    //a single copy, timed as one operation
+    record("copy", measure(1, [&](size_t) {
+        Container copy = *container;
+        sink += copy.size();
+    }), bytesPerEntry);
+
+    //removes every key once, in insertion order, since zipfian lookups repeat keys
+    record("remove", measure(n, [&](size_t i) {
+        sink += container->remove(keys[workload.insertOrder[i]]);
+    }), bytesPerEntry);
+}
+
+//Output
+
+static void printTable(const vector<Result>& results)
+{
+    printf("%-14s %-10s %10s %-9s %14s %9s %9s %9s %9s %9s %8s %8s\n",
+           "container", "workload", "size", "op", "ops/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "B/entry", "cmp/op", "rot/op");
+    for (const Result& r : results)
+    {
+        printf("%-14s %-10s %10zu %-9s %14.0f %9.0f %9.0f %9.0f %9.0f %9.1f %8.2f %8.3f\n",
+               r.container.c_str(), r.workload.c_str(), r.size, r.operation.c_str(),
+               r.opsPerSecond, r.p50, r.p90, r.p99, r.p999, r.bytesPerEntry, r.comparisonsPerOp, r.rotationsPerOp);
+    }
+}
+
+static void printJson(const vector<Result>& results)
+{
+    cout << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        cout << "  {\"container\": \"" << r.container << "\", \"workload\": \"" << r.workload
+             << "\", \"size\": " << r.size << ", \"operation\": \"" << r.operation
+             << "\", \"ops\": " << r.ops << ", \"ops_per_sec\": " << r.opsPerSecond
+             << ", \"latency_ns\": {\"p50\": " << r.p50 << ", \"p90\": " << r.p90
+             << ", \"p99\": " << r.p99 << ", \"p999\": " << r.p999
+             << "}, \"bytes_per_entry\": " << r.bytesPerEntry
+             << ", \"comparisons_per_op\": " << r.comparisonsPerOp
+             << ", \"rotations_per_op\": " << r.rotationsPerOp << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    cout << "]" << endl;
+}
+
+//splits a comma separated argument
+static vector<string> splitList(const string& text)
+{
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+int main(int argc, char* argv[])
+{
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    vector<string> workloads = {"sequential", "reverse", "random", "zipfian"};
+    vector<string> containers = {"avltree", "avltree_cached", "avltree_relaxed", "avltree_compact", "btree", "map", "unordered_map"};
+    bool json = false;
+    bool hierarchicalKeys = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--json")
+        {
+            json = true;
+        }
+        else if (arg == "--sizes" && i + 1 < argc)
+        {
+            sizes.clear();
+            for (const string& size : splitList(argv[++i]))
+            {
+                sizes.push_back(stoull(size));
+            }
+        }
+        else if (arg == "--workloads" && i + 1 < argc)
+        {
+            workloads = splitList(argv[++i]);
+        }
+        else if (arg == "--containers" && i + 1 < argc)
+        {
+            containers = splitList(argv[++i]);
+        }
+        else if (arg == "--keys" && i + 1 < argc)
+        {
+            hierarchicalKeys = string(argv[++i]) == "hierarchical";
+        }else
+        {
+            cerr << "usage: " << argv[0] << " [--sizes 1000,10000,...] [--workloads sequential,reverse,random,zipfian]"
+                 << " [--containers avltree,avltree_cached,avltree_relaxed,avltree_compact,btree,map,unordered_map] [--keys short|hierarchical] [--json]" << endl;
+            return 1;
+        }
+    }
+
+    vector<Result> results;
+    for (size_t n : sizes)
+    {
+        vector<string> keys;
+        keys.reserve(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            keys.push_back(makeKey(i, hierarchicalKeys));
+        }
+
+        for (const string& workloadName : workloads)
+        {
+            Workload workload = makeWorkload(workloadName, n);
+            for (const string& container : containers)
+            {
+                if (container == "avltree")
+                {
+                    runContainer<AVLTreeAdapter>(workload, keys, results);
+                }
+                else if (container == "avltree_cached")
+                {
+                    runContainer<CachedAVLTreeAdapter>(workload, keys, results);
+                }
+                else if (container == "avltree_relaxed")
+                {
+                    runContainer<RelaxedAVLTreeAdapter>(workload, keys, results);
+                }
+                else if (container == "avltree_compact")
+                {
+                    runContainer<CompactAVLTreeAdapter>(workload, keys, results);
+                }
+                else if (container == "btree")
+                {
+                    runContainer<BTreeAdapter>(workload, keys, results);
+                }
+                else if (container == "map")
+                {
+                    runContainer<MapAdapter>(workload, keys, results);
+                }
+                else if (container == "unordered_map")
+                {
+                    runContainer<UnorderedMapAdapter>(workload, keys, results);
+                }
+            }
+            //progress goes to stderr so --json output stays clean
+            cerr << "done: " << workloadName << " " << n << endl;
+        }
+    }
+
+    if (json)
+    {
+        printJson(results);
+    }else
+    {
+        printTable(results);
+    }
+    return sink == SIZE_MAX;
+}
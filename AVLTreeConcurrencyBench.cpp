@@ -0,0 +1,238 @@
+/*
+Reader scaling benchmark for ConcurrentAVLTree and LockFreeAVLTree.
+Fills a tree, then runs 1, 2, 4, ... reader threads doing random get() calls for a fixed time,
+optionally next to one writer thread that keeps inserting and removing keys.
+Prints the total and per-thread read throughput for each thread count.
+
+With stress set, it instead runs the readers next to two writers that move amounts between pairs of keys
+and one that inserts, removes and erases ranges, and counts reads that see a pair with the wrong total
+or a filled key with the wrong value. The exit code is 1 if there were any.
+
+usage: AVLTreeConcurrencyBench [number of keys] [max reader threads] [milliseconds per run] [writer: 0 or 1] [stress: 0 or 1]
+ */
+#include "ConcurrentAVLTree.h"
+#include "LockFreeAVLTree.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+//makes fixed-width keys so string order matches numeric order
+static string makeKey(size_t i)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "key/%010zu", i);
+    return buffer;
+}
+
+//runs the given number of readers for the given time and returns the number of completed reads
+template <class Tree>
+static size_t runReaders(Tree& tree, size_t keyCount, size_t readerCount, chrono::milliseconds duration, bool withWriter)
+{
+    //the keys are made up front so the readers time only the lookups
+    vector<string> keys;
+    keys.reserve(keyCount);
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        keys.push_back(makeKey(i));
+    }
+
+    atomic<bool> stop{false};
+    atomic<size_t> totalReads{0};
+    vector<thread> threads;
+
+    for (size_t t = 0; t < readerCount; t++)
+    {
+        threads.emplace_back([&, t] {
+            mt19937_64 rng(t + 1);
+            size_t reads = 0;
+            size_t found = 0;
+            while (!stop.load(memory_order_relaxed))
+            {
+                //checks the stop flag every 256 reads to keep it off the hot path
+                for (int i = 0; i < 256; i++)
+                {
+                    found += tree.get(keys[rng() % keyCount]).has_value();
+                }
+                reads += 256;
+            }
+            totalReads += reads;
+            //keeps the lookups from being optimized away
+            if (found == SIZE_MAX)
+            {
+                cout << found;
+            }
+        });
+    }
+
+    if (withWriter)
+    {
+        threads.emplace_back([&] {
+            mt19937_64 rng(12345);
+            while (!stop.load(memory_order_relaxed))
+            {
+                string key = makeKey(keyCount + rng() % keyCount);
+                if (!tree.insert(key, 0))
+                {
+                    tree.remove(key);
+                }
+            }
+        });
+    }
+
+    this_thread::sleep_for(duration);
+    stop = true;
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+    return totalReads;
+}
+
+//every pair of keys holds this total between its two values
+static constexpr size_t PAIR_TOTAL = 1000;
+static constexpr size_t PAIR_COUNT = 1024;
+
+static string makePairKey(size_t pair, char side)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "pair/%06zu/%c", pair, side);
+    return buffer;
+}
+
+//runs the readers next to the writers for the given time. Returns the number of reads that saw a state
+//no single version had: a pair whose values do not add up, or a filled key with a value other than its own number
+template <class Tree>
+static size_t runStress(Tree& tree, size_t keyCount, size_t readerCount, chrono::milliseconds duration)
+{
+    for (size_t pair = 0; pair < PAIR_COUNT; pair++)
+    {
+        tree.insert_or_assign(makePairKey(pair, 'a'), PAIR_TOTAL);
+        tree.insert_or_assign(makePairKey(pair, 'b'), 0);
+    }
+    vector<string> keys;
+    keys.reserve(keyCount);
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        keys.push_back(makeKey(i));
+    }
+
+    atomic<bool> stop{false};
+    atomic<size_t> totalReads{0};
+    atomic<size_t> violations{0};
+    vector<thread> threads;
+
+    for (size_t t = 0; t < readerCount; t++)
+    {
+        threads.emplace_back([&, t] {
+            mt19937_64 rng(t + 1);
+            size_t reads = 0;
+            size_t wrong = 0;
+            while (!stop.load(memory_order_relaxed))
+            {
+                size_t pair = rng() % PAIR_COUNT;
+                string a = makePairKey(pair, 'a');
+                string b = makePairKey(pair, 'b');
+                size_t total = tree.read([&](const AVLTree& version) {
+                    return version.get(a).value_or(0) + version.get(b).value_or(0);
+                });
+                wrong += total != PAIR_TOTAL;
+                size_t i = rng() % keyCount;
+                wrong += tree.get(keys[i]) != optional<size_t>(i);
+                reads += 2;
+            }
+            totalReads += reads;
+            violations += wrong;
+        });
+    }
+
+    //moves a random amount from one side of a pair to the other in a single write
+    for (size_t w = 0; w < 2; w++)
+    {
+        threads.emplace_back([&, w] {
+            mt19937_64 rng(1000 + w);
+            while (!stop.load(memory_order_relaxed))
+            {
+                size_t pair = rng() % PAIR_COUNT;
+                string from = makePairKey(pair, rng() % 2 ? 'a' : 'b');
+                string to = makePairKey(pair, from.back() == 'a' ? 'b' : 'a');
+                size_t amount = rng();
+                tree.write([&](AVLTree& version) {
+                    size_t moved = amount % (*version.get(from) + 1);
+                    version[from] -= moved;
+                    version[to] += moved;
+                });
+            }
+        });
+    }
+
+    //churns keys outside the checked ones, so versions are retired with removed and rotated nodes
+    threads.emplace_back([&] {
+        mt19937_64 rng(12345);
+        while (!stop.load(memory_order_relaxed))
+        {
+            size_t i = keyCount + rng() % keyCount;
+            if (rng() % 64 == 0)
+            {
+                tree.eraseRange(makeKey(i), makeKey(i + 64));
+            }else if (!tree.insert(makeKey(i), i))
+            {
+                tree.remove(makeKey(i));
+            }
+        }
+    });
+
+    this_thread::sleep_for(duration);
+    stop = true;
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+    cout << readerCount << " readers: " << totalReads << " reads, " << violations << " wrong" << endl;
+    return violations;
+}
+
+//fills the tree and runs either the scaling benchmark or the stress test for 1, 2, 4, ... readers
+template <class Tree>
+static size_t runAll(const char* name, size_t keyCount, size_t maxReaders, chrono::milliseconds duration, bool withWriter, bool stress)
+{
+    Tree tree;
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        tree.insert(makeKey(i), i);
+    }
+
+    size_t violations = 0;
+    cout << name << ", keys: " << keyCount << ", " << (stress ? "stress" : withWriter ? "writer: yes" : "writer: no") << endl;
+    for (size_t readers = 1; readers <= maxReaders; readers *= 2)
+    {
+        if (stress)
+        {
+            violations += runStress(tree, keyCount, readers, duration);
+            continue;
+        }
+        size_t reads = runReaders(tree, keyCount, readers, duration, withWriter);
+        double seconds = chrono::duration<double>(duration).count();
+        cout << readers << " readers: " << reads / seconds << " reads/s total, "
+             << reads / seconds / readers << " reads/s per thread" << endl;
+    }
+    return violations;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t keyCount = max<size_t>(argc > 1 ? stoul(argv[1]) : 1000000, 1);
+    size_t maxReaders = argc > 2 ? stoul(argv[2]) : max(1u, thread::hardware_concurrency());
+    chrono::milliseconds duration(argc > 3 ? stoul(argv[3]) : 1000);
+    bool withWriter = argc > 4 && stoul(argv[4]) != 0;
+    bool stress = argc > 5 && stoul(argv[5]) != 0;
+
+    size_t violations = runAll<ConcurrentAVLTree>("ConcurrentAVLTree", keyCount, maxReaders, duration, withWriter, stress);
+    violations += runAll<LockFreeAVLTree>("LockFreeAVLTree", keyCount, maxReaders, duration, withWriter, stress);
+    return violations == 0 ? 0 : 1;
+}
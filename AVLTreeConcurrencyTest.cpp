@@ -0,0 +1,224 @@
+/*
+Test for ConcurrentAVLTree and LockFreeAVLTree.
+Runs readers next to writers and checks that every read sees a state some single version of the tree had:
+writers move amounts between the two keys of a pair in one write, so each pair always adds up to the same
+total, and every write bumps a counter, which a reader must never see go back. A third writer inserts,
+removes, assigns and erases ranges, so LockFreeAVLTree retires and frees versions with removed and rotated
+nodes while the readers run. Each writer keeps its own std::map of the keys only it changes, and the tree
+must match them all afterwards. ConcurrentAVLTree runs a second time in relaxed balance with its maintenance
+thread rebalancing in the background, and its readers also check the structure of the tree with isValid.
+
+usage: AVLTreeConcurrencyTest [writes per writer] [reader threads]
+ */
+#include "ConcurrentAVLTree.h"
+#include "LockFreeAVLTree.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+//every pair of keys holds this total between its two values
+static constexpr size_t PAIR_TOTAL = 1000;
+static constexpr size_t PAIR_COUNT = 256;
+static constexpr size_t CHURN_KEYS = 4096;
+//bumped by every write
+static const string WRITE_COUNTER = "writes";
+
+static string makePairKey(size_t pair, char side)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "pair/%06zu/%c", pair, side);
+    return buffer;
+}
+
+static string makeChurnKey(size_t i)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "churn/%06zu", i);
+    return buffer;
+}
+
+//checks one version as a whole: keys in order, as many as size says, and every pair adding up. The structure
+//is only checked where writers are locked out, since under LockFreeAVLTree they change the nodes' reference
+//counts, which share a word with the heights
+static void checkVersion(const AVLTree& version, const char* name, bool checkStructure)
+{
+    check(!checkStructure || version.isValid(), string(name) + ": isValid");
+    size_t count = 0;
+    string previous;
+    map<string, size_t> pairTotals;
+    for (auto [key, value] : version)
+    {
+        check(count == 0 || previous < key, string(name) + ": keys in order");
+        previous = key;
+        count++;
+        if (key.starts_with("pair/"))
+        {
+            pairTotals[key.substr(0, key.size() - 2)] += value;
+        }
+    }
+    check(count == version.size(), string(name) + ": size matches the keys walked");
+    check(pairTotals.size() == PAIR_COUNT, string(name) + ": every pair is there");
+    for (const auto& [pair, total] : pairTotals)
+    {
+        check(total == PAIR_TOTAL, string(name) + ": " + pair + " adds up");
+    }
+}
+
+template <class Tree>
+static void runTest(Tree& tree, const char* name, size_t writesPerWriter, size_t readerCount)
+{
+    constexpr bool LOCKED_READS = is_same_v<Tree, ConcurrentAVLTree>;
+    //the pairs each writer owns, and the keys and values only it changes
+    const size_t PAIR_WRITERS = 2;
+    vector<map<string, size_t>> expected(PAIR_WRITERS + 1);
+    for (size_t pair = 0; pair < PAIR_COUNT; pair++)
+    {
+        tree.insert(makePairKey(pair, 'a'), PAIR_TOTAL);
+        tree.insert(makePairKey(pair, 'b'), 0);
+        expected[pair % PAIR_WRITERS][makePairKey(pair, 'a')] = PAIR_TOTAL;
+        expected[pair % PAIR_WRITERS][makePairKey(pair, 'b')] = 0;
+    }
+    tree.insert(WRITE_COUNTER, 0);
+
+    atomic<size_t> writersLeft{PAIR_WRITERS + 1};
+    vector<thread> threads;
+
+    for (size_t r = 0; r < readerCount; r++)
+    {
+        threads.emplace_back([&, r] {
+            mt19937_64 rng(r + 1);
+            size_t lastWrites = 0;
+            for (size_t i = 0; writersLeft.load(memory_order_acquire) > 0; i++)
+            {
+                size_t index = rng() % PAIR_COUNT;
+                string a = makePairKey(index, 'a');
+                string b = makePairKey(index, 'b');
+                auto [total, writes] = tree.read([&](const AVLTree& version) {
+                    return pair<size_t, size_t>(version.get(a).value_or(0) + version.get(b).value_or(0), version.get(WRITE_COUNTER).value_or(0));
+                });
+                check(total == PAIR_TOTAL, string(name) + ": " + a + " and " + b + " add up");
+                check(writes >= lastWrites, string(name) + ": the write counter never goes back");
+                lastWrites = writes;
+                if (i % 256 == 0)
+                {
+                    tree.read([&](const AVLTree& version) { checkVersion(version, name, LOCKED_READS); });
+                }
+            }
+        });
+    }
+
+    //moves a random amount from one side of one of its pairs to the other in a single write
+    for (size_t w = 0; w < PAIR_WRITERS; w++)
+    {
+        threads.emplace_back([&, w] {
+            mt19937_64 rng(1000 + w);
+            map<string, size_t>& mine = expected[w];
+            for (size_t i = 0; i < writesPerWriter; i++)
+            {
+                size_t pair = rng() % (PAIR_COUNT / PAIR_WRITERS) * PAIR_WRITERS + w;
+                string from = makePairKey(pair, rng() % 2 ? 'a' : 'b');
+                string to = makePairKey(pair, from.back() == 'a' ? 'b' : 'a');
+                size_t moved = rng() % (mine[from] + 1);
+                mine[from] -= moved;
+                mine[to] += moved;
+                tree.write([&](AVLTree& version) {
+                    version.insert_or_assign(from, *version.get(from) - moved);
+                    version.insert_or_assign(to, *version.get(to) + moved);
+                    version.insert_or_assign(WRITE_COUNTER, *version.get(WRITE_COUNTER) + 1);
+                });
+            }
+            writersLeft--;
+        });
+    }
+
+    //churns keys of its own through the single-operation writers
+    threads.emplace_back([&] {
+        mt19937_64 rng(12345);
+        map<string, size_t>& mine = expected[PAIR_WRITERS];
+        for (size_t i = 0; i < writesPerWriter; i++)
+        {
+            size_t k = rng() % CHURN_KEYS;
+            string key = makeChurnKey(k);
+            if (rng() % 64 == 0)
+            {
+                string highKey = makeChurnKey(k + 32);
+                size_t erased = 0;
+                for (auto it = mine.lower_bound(key); it != mine.end() && it->first <= highKey; erased++)
+                {
+                    it = mine.erase(it);
+                }
+                check(tree.eraseRange(key, highKey) == erased, string(name) + ": eraseRange from " + key);
+            }else if (rng() % 3 == 0)
+            {
+                check(tree.remove(key) == (mine.erase(key) == 1), string(name) + ": remove " + key);
+            }else if (rng() % 4 == 0)
+            {
+                auto it = mine.find(key);
+                if (it != mine.end())
+                {
+                    it->second = i;
+                }
+                check(tree.assign(key, i) == (it != mine.end()), string(name) + ": assign " + key);
+            }else
+            {
+                check(tree.insert_or_assign(key, i) == mine.insert_or_assign(key, i).second, string(name) + ": insert_or_assign " + key);
+            }
+            tree.write([](AVLTree& version) { version.insert_or_assign(WRITE_COUNTER, *version.get(WRITE_COUNTER) + 1); });
+        }
+        writersLeft--;
+    });
+
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+
+    map<string, size_t> all;
+    for (const map<string, size_t>& mine : expected)
+    {
+        all.insert(mine.begin(), mine.end());
+    }
+    all[WRITE_COUNTER] = writesPerWriter * (PAIR_WRITERS + 1);
+    check(tree.size() == all.size(), string(name) + ": final size");
+    vector<string> keys = tree.keys();
+    check(keys.size() == all.size(), string(name) + ": final key count");
+    size_t i = 0;
+    for (const auto& [key, value] : all)
+    {
+        check(i < keys.size() && keys[i] == key, string(name) + ": final key " + key);
+        check(tree.get(key) == value, string(name) + ": final value of " + key);
+        i++;
+    }
+    tree.read([&](const AVLTree& version) { checkVersion(version, name, true); });
+    cout << name << ": done" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t writesPerWriter = argc > 1 ? stoul(argv[1]) : 5000;
+    size_t readerCount = argc > 2 ? stoul(argv[2]) : 3;
+
+    ConcurrentAVLTree locked;
+    runTest(locked, "ConcurrentAVLTree", writesPerWriter, readerCount);
+    LockFreeAVLTree lockFree;
+    runTest(lockFree, "LockFreeAVLTree", writesPerWriter, readerCount);
+
+    ConcurrentAVLTree maintained;
+    maintained.startMaintenance(chrono::milliseconds(1), 64);
+    runTest(maintained, "ConcurrentAVLTree with maintenance", writesPerWriter, readerCount);
+    maintained.stopMaintenance();
+    check(maintained.read([](const AVLTree& tree) { return !tree.isRelaxedBalance() && tree.isValid(); }),
+          "ConcurrentAVLTree with maintenance: AVL balance after stopMaintenance");
+
+    return testResult();
+}
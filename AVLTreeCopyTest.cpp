@@ -0,0 +1,204 @@
+/*
+Test for AVLTree's copy-on-write copies.
+Checks that a reference from operator[] taken after a copy or an assignment changes only its own tree,
+that taking it again after a copy gives a node of the tree's own, and that a chain of copies changed at
+random, sorted batches included, keeps every tree equal to a std::map that had the same changes. Also checks
+that copies, assignments and the upper tree of a split keep the settings of the tree they came from, and
+that a copy's hot cache answers from the copy alone.
+
+usage: AVLTreeCopyTest [seeds]
+ */
+#include "AVLTree.h"
+#include "TestSupport.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+static void checkTree(const AVLTree& tree, const map<string, size_t>& expected, const string& what)
+{
+    check(tree.isValid(), what + ": isValid");
+    check(tree.size() == expected.size(), what + ": size");
+    auto it = expected.begin();
+    for (auto [key, value] : tree)
+    {
+        if (it == expected.end() || key != it->first || value != it->second)
+        {
+            check(false, what + ": contents at " + key);
+            return;
+        }
+        ++it;
+    }
+}
+
+//a copy invalidates references into the original, and operator[] hands out a fresh one that is not shared
+static void testReferences()
+{
+    AVLTree tree;
+    for (size_t i = 0; i < 100; i++)
+    {
+        tree.insert(makeKey(i), i);
+    }
+    size_t& before = tree[makeKey(50)];
+    AVLTree copy(tree);
+    size_t& after = tree[makeKey(50)];
+    check(&after != &before, "operator[] after a copy gives a node of the tree's own");
+    after = 999;
+    check(tree.get(makeKey(50)) == 999, "a write through the new reference changes the tree");
+    check(copy.get(makeKey(50)) == 50, "a write through the new reference leaves the copy alone");
+    check(&copy[makeKey(50)] == &before, "the copy keeps the shared node once the original has let go of it");
+
+    copy[makeKey(10)] = 1000;
+    check(tree.get(makeKey(10)) == 10, "a write through the copy's reference leaves the original alone");
+
+    AVLTree assigned;
+    assigned.insert("other", 1);
+    assigned = tree;
+    assigned[makeKey(20)] = 2000;
+    tree[makeKey(30)] = 3000;
+    check(tree.get(makeKey(20)) == 20, "a write through the assigned tree leaves the source alone");
+    check(assigned.get(makeKey(30)) == 30, "a write through the source leaves the assigned tree alone");
+    check(!assigned.contains("other"), "assignment replaces the old contents");
+
+    //a missing key inserted through operator[] goes into the copy only
+    copy["new"] = 7;
+    check(!tree.contains("new") && copy.get("new") == 7, "operator[] inserts into the copy only");
+}
+
+//settings a tree was given carry over to the trees made from it
+static void testSettings()
+{
+    AVLTree tree;
+    tree.setParallelCutoff(1234);
+    tree.setRelaxedBalance(true);
+    for (size_t i = 0; i < 100; i++)
+    {
+        tree.insert(makeKey(i), i);
+    }
+    AVLTree copy(tree);
+    AVLTree assigned;
+    assigned = tree;
+    AVLTree upper = tree.split(makeKey(50));
+    for (const AVLTree* derived : {&copy, &assigned, &upper})
+    {
+        check(derived->getParallelCutoff() == 1234, "a derived tree keeps the parallel cutoff");
+        check(derived->isRelaxedBalance(), "a derived tree keeps relaxed balance");
+    }
+}
+
+//a copy gets a cache of the same size that fills on its own lookups, and a change to either tree leaves the
+//other's cached lookups right
+static void testHotCache()
+{
+    AVLTree tree;
+    tree.setHotCacheSize(64);
+    for (size_t i = 0; i < 100; i++)
+    {
+        tree.insert(makeKey(i), i);
+        check(tree.get(makeKey(i)) == i, "cached get before copying");
+    }
+    AVLTree copy(tree);
+    check(copy.hotCacheStats().slots == 64, "a copy's cache has the same size");
+    check(copy.hotCacheStats().hits == 0 && copy.hotCacheStats().misses == 0, "a copy's cache starts empty");
+    for (size_t round = 0; round < 2; round++)
+    {
+        for (size_t i = 0; i < 100; i++)
+        {
+            check(copy.get(makeKey(i)) == i, "cached get on the copy");
+        }
+    }
+    check(copy.hotCacheStats().hits > 0, "a copy's cache is used");
+
+    tree.insert_or_assign(makeKey(5), 500);
+    tree.remove(makeKey(6));
+    copy[makeKey(7)] = 700;
+    check(copy.get(makeKey(5)) == 5 && copy.contains(makeKey(6)), "changes to the original do not show in the copy's cache");
+    check(tree.get(makeKey(7)) == 7, "changes to the copy do not show in the original's cache");
+    check(tree.get(makeKey(5)) == 500 && !tree.contains(makeKey(6)), "the original's cache follows its own changes");
+}
+
+//keeps a few trees that are copies of each other, changes one at a time, and checks all of them
+static void testCopyChains(uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    string name = "seed " + to_string(seed);
+    vector<AVLTree> trees(1);
+    vector<map<string, size_t>> expected(1);
+    for (size_t step = 0; step < 3000; step++)
+    {
+        size_t t = rng() % trees.size();
+        string key = makeKey(rng() % 500);
+        switch (rng() % 7)
+        {
+            case 0:
+                trees[t].insert(key, step);
+                expected[t].emplace(key, step);
+                break;
+            case 1:
+                trees[t].remove(key);
+                expected[t].erase(key);
+                break;
+            case 2:
+                trees[t][key] = step;
+                expected[t][key] = step;
+                break;
+            case 3:
+                trees[t].insert_or_assign(key, step);
+                expected[t].insert_or_assign(key, step);
+                break;
+            case 4:
+            {
+                //a sorted batch large enough that a tree of its own would be rebuilt
+                vector<pair<string, size_t>> batch;
+                for (size_t k = rng() % 500; k < 500 && batch.size() < 200; k += 1 + rng() % 3)
+                {
+                    batch.emplace_back(makeKey(k), step);
+                }
+                trees[t].insertMany(batch);
+                expected[t].insert(batch.begin(), batch.end());
+                break;
+            }
+            case 5:
+                if (trees.size() < 6)
+                {
+                    trees.push_back(trees[t]);
+                    expected.push_back(expected[t]);
+                }
+                break;
+            default:
+            {
+                size_t other = rng() % trees.size();
+                trees[t] = trees[other];
+                expected[t] = expected[other];
+                break;
+            }
+        }
+        if (step % 100 == 0)
+        {
+            for (size_t i = 0; i < trees.size(); i++)
+            {
+                checkTree(trees[i], expected[i], name + ", step " + to_string(step) + ", tree " + to_string(i));
+            }
+        }
+    }
+    for (size_t i = 0; i < trees.size(); i++)
+    {
+        checkTree(trees[i], expected[i], name + ", tree " + to_string(i));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t seeds = argc > 1 ? stoul(argv[1]) : 4;
+    testReferences();
+    testSettings();
+    testHotCache();
+    for (uint64_t seed = 0; seed < seeds; seed++)
+    {
+        testCopyChains(seed);
+    }
+    return testResult();
+}
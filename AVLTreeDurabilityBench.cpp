@@ -0,0 +1,169 @@
+/*
+Benchmark for DurableAVLTree.
+Times the same random inserts, assigns and removes on a plain AVLTree and on a DurableAVLTree under each
+sync policy, then times recovering the tree from the log, checkpointing, and recovering from the snapshot.
+Every recovered tree is checked against the plain one.
+
+usage: AVLTreeDurabilityBench [number of changes] [directory]
+ */
+#include "AVLTree.h"
+#include "DurableAVLTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+//makes fixed-width keys so string order matches numeric order
+static string makeKey(size_t i)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "key/%010zu", i);
+    return buffer;
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//a change: the key, and the value to give it, or remove for a remove
+struct Change {
+    const string* key;
+    size_t value;
+    bool remove;
+};
+
+//applies the first count changes: half inserts of new keys, and the rest split between assigns and removes
+template <class Tree>
+static void applyChanges(Tree& tree, const vector<Change>& changes, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const Change& change = changes[i];
+        if (change.remove)
+        {
+            tree.remove(*change.key);
+        }else if (i % 2 == 0)
+        {
+            tree.insert(*change.key, change.value);
+        }else
+        {
+            tree.insert_or_assign(*change.key, change.value);
+        }
+    }
+}
+
+//counts keys whose values differ between the durable tree and the plain one
+static size_t countMismatches(const DurableAVLTree& durable, const AVLTree& expected, const vector<string>& keys)
+{
+    size_t mismatches = durable.size() != expected.size();
+    for (const string& key : keys)
+    {
+        mismatches += durable.get(key) != expected.get(key);
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = max<size_t>(argc > 1 ? stoul(argv[1]) : 1000000, 1);
+    string directory = argc > 2 ? argv[2] : "avltree_durability";
+
+    vector<string> keys;
+    keys.reserve(count / 2 + 1);
+    for (size_t i = 0; i <= count / 2; i++)
+    {
+        keys.push_back(makeKey(i));
+    }
+    mt19937_64 rng(42);
+    vector<Change> changes(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        changes[i] = {&keys[rng() % keys.size()], rng() % 1000000, i % 4 == 3};
+    }
+
+    auto start = chrono::steady_clock::now();
+    AVLTree plain;
+    applyChanges(plain, changes, count);
+    cout << "AVLTree: " << millisecondsSince(start) * 1e6 / count << " ns/change" << endl;
+
+    //Always waits for the disk on every change, so it gets fewer of them
+    struct Run {
+        const char* name;
+        DurableAVLTree::SyncPolicy policy;
+        size_t changes;
+    };
+    Run runs[] = {
+        {"never", DurableAVLTree::SyncPolicy::Never, count},
+        {"interval", DurableAVLTree::SyncPolicy::Interval, count},
+        {"always", DurableAVLTree::SyncPolicy::Always, min<size_t>(count, 2000)},
+    };
+    size_t mismatches = 0;
+    for (const Run& run : runs)
+    {
+        filesystem::remove_all(directory);
+        DurableAVLTree durable;
+        if (!durable.open(directory, {run.policy}))
+        {
+            cerr << "could not open " << directory << endl;
+            return 1;
+        }
+        start = chrono::steady_clock::now();
+        applyChanges(durable, changes, run.changes);
+        double elapsed = millisecondsSince(start);
+        if (!durable.sync())
+        {
+            cerr << "could not write the log" << endl;
+            return 1;
+        }
+        cout << "DurableAVLTree, sync " << run.name << ": " << elapsed * 1e6 / run.changes << " ns/change" << endl;
+    }
+
+    //the last run left a short log, so recovery is timed on a full one
+    filesystem::remove_all(directory);
+    {
+        DurableAVLTree durable;
+        durable.open(directory, {DurableAVLTree::SyncPolicy::Never});
+        applyChanges(durable, changes, count);
+    }
+    cout << "log size: " << filesystem::file_size(directory + "/log.wal") / 1024 << " KiB" << endl;
+
+    start = chrono::steady_clock::now();
+    DurableAVLTree recovered;
+    if (!recovered.open(directory))
+    {
+        cerr << "could not recover " << directory << endl;
+        return 1;
+    }
+    cout << "recover from log: " << millisecondsSince(start) << " ms" << endl;
+    mismatches += countMismatches(recovered, plain, keys);
+
+    start = chrono::steady_clock::now();
+    if (!recovered.checkpoint())
+    {
+        cerr << "could not checkpoint" << endl;
+        return 1;
+    }
+    cout << "checkpoint: " << millisecondsSince(start) << " ms" << endl;
+    recovered.close();
+
+    start = chrono::steady_clock::now();
+    DurableAVLTree reopened;
+    if (!reopened.open(directory))
+    {
+        cerr << "could not reopen " << directory << endl;
+        return 1;
+    }
+    cout << "recover from snapshot: " << millisecondsSince(start) << " ms" << endl;
+    mismatches += countMismatches(reopened, plain, keys);
+    cout << "mismatches: " << mismatches << endl;
+
+    reopened.close();
+    filesystem::remove_all(directory);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+Test for WriteAheadLog and DurableAVLTree.
+Makes random changes to a DurableAVLTree and a std::map side by side, then checks recovery against the map:
+from the log cut short at every length, as a crash in the middle of a write would leave it, from a log
+with a damaged record, and from a crash between writing a checkpoint's snapshot and emptying the log.
+Then makes writes fail by lowering the process's file size limit, and checks that a change whose record
+could not be logged is neither made nor reported as made.
+
+usage: AVLTreeDurabilityTest [directory]
+ */
+#include "DurableAVLTree.h"
+#include "TestSupport.h"
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+static bool matches(const DurableAVLTree& durable, const map<string, uint64_t>& expected)
+{
+    if (durable.size() != expected.size())
+    {
+        return false;
+    }
+    auto it = expected.begin();
+    for (auto [key, value] : durable.contents())
+    {
+        if (key != it->first || value != it->second)
+        {
+            return false;
+        }
+        ++it;
+    }
+    return true;
+}
+
+//makes one random change of each kind in turn to both trees
+static void applyChange(DurableAVLTree& durable, map<string, uint64_t>& expected, mt19937_64& rng, size_t step)
+{
+    string key = makeKey(rng() % 40);
+    uint64_t value = rng();
+    switch (step % 4)
+    {
+        case 0:
+            check(durable.insert(key, value) == expected.emplace(key, value).second, "insert " + key);
+            break;
+        case 1:
+            check(durable.insert_or_assign(key, value) == expected.insert_or_assign(key, value).second, "insert_or_assign " + key);
+            break;
+        case 2:
+            check(durable.remove(key) == (expected.erase(key) == 1), "remove " + key);
+            break;
+        default:
+        {
+            string highKey = makeKey(rng() % 40);
+            if (highKey < key)
+            {
+                swap(key, highKey);
+            }
+            size_t erased = 0;
+            for (auto it = expected.lower_bound(key); it != expected.end() && it->first <= highKey; erased++)
+            {
+                it = expected.erase(it);
+            }
+            check(durable.eraseRange(key, highKey) == erased, "eraseRange " + key + " " + highKey);
+            break;
+        }
+    }
+}
+
+//cuts the log at every length, and damages each record in turn. Recovery has to give the tree as it was
+//after the last whole record, and new changes have to follow that record
+static void testReplay(const string& directory)
+{
+    const size_t CHANGES = 80;
+    string logPath = directory + "/log.wal";
+    filesystem::remove_all(directory);
+
+    //with SyncPolicy::Always every change is in the file when it returns, so the file size after each
+    //change is where its record ends
+    vector<map<string, uint64_t>> states(1);
+    vector<size_t> ends;
+    {
+        DurableAVLTree durable;
+        check(durable.open(directory, {DurableAVLTree::SyncPolicy::Always}), "open a new log");
+        ends.push_back(filesystem::file_size(logPath));
+        mt19937_64 rng(7);
+        map<string, uint64_t> expected;
+        for (size_t step = 0; step < CHANGES; step++)
+        {
+            applyChange(durable, expected, rng, step);
+            if (filesystem::file_size(logPath) != ends.back())
+            {
+                ends.push_back(filesystem::file_size(logPath));
+                states.push_back(expected);
+            }
+        }
+    }
+    string log = readFile(logPath);
+    check(log.size() == ends.back(), "closing writes nothing more");
+
+    size_t last = 0;
+    for (size_t length = 0; length <= log.size(); length++)
+    {
+        while (last + 1 < ends.size() && ends[last + 1] <= length)
+        {
+            last++;
+        }
+        writeFile(logPath, log.substr(0, length));
+        DurableAVLTree recovered;
+        if (!recovered.open(directory, {DurableAVLTree::SyncPolicy::Always}))
+        {
+            check(false, "open a log cut to " + to_string(length) + " bytes");
+            continue;
+        }
+        check(matches(recovered, states[last]), "recover a log cut to " + to_string(length) + " bytes");
+        check(recovered.insert("new", length), "insert after recovering a log cut to " + to_string(length) + " bytes");
+        recovered.close();
+
+        check(recovered.open(directory), "reopen a log cut to " + to_string(length) + " bytes");
+        map<string, uint64_t> withNew = states[last];
+        withNew.emplace("new", length);
+        check(matches(recovered, withNew), "a change after a cut follows the last whole record, cut to " + to_string(length) + " bytes");
+    }
+
+    //a damaged byte ends the log at the record it is in, even with good records after it
+    for (size_t record = 1; record < ends.size(); record++)
+    {
+        string damaged = log;
+        damaged[ends[record] - 1] ^= 0x40;
+        writeFile(logPath, damaged);
+        DurableAVLTree recovered;
+        check(recovered.open(directory), "open a log with record " + to_string(record) + " damaged");
+        check(matches(recovered, states[record - 1]), "recover a log with record " + to_string(record) + " damaged");
+        recovered.close();
+        check(filesystem::file_size(logPath) == ends[record - 1], "the damaged record and those after it are cut off, record " + to_string(record));
+    }
+}
+
+//a crash after a checkpoint's snapshot is in place but before the log is emptied replays the whole log
+//onto the snapshot, which has to give the same tree
+static void testCheckpoint(const string& directory)
+{
+    string logPath = directory + "/log.wal";
+    filesystem::remove_all(directory);
+    map<string, uint64_t> expected;
+    string log;
+    {
+        DurableAVLTree durable;
+        check(durable.open(directory, {DurableAVLTree::SyncPolicy::Never}), "open for checkpoint");
+        mt19937_64 rng(11);
+        for (size_t step = 0; step < 400; step++)
+        {
+            applyChange(durable, expected, rng, step);
+        }
+        check(durable.sync(), "sync before checkpoint");
+        log = readFile(logPath);
+        check(durable.checkpoint(), "checkpoint");
+        check(filesystem::file_size(logPath) < log.size(), "checkpoint empties the log");
+    }
+    DurableAVLTree fromSnapshot;
+    check(fromSnapshot.open(directory), "open from snapshot");
+    check(matches(fromSnapshot, expected), "recover from snapshot");
+    fromSnapshot.close();
+
+    writeFile(logPath, log);
+    DurableAVLTree replayed;
+    check(replayed.open(directory), "open from snapshot and old log");
+    check(matches(replayed, expected), "replaying the old log onto the snapshot changes nothing");
+}
+
+//lowers the file size limit so the log cannot grow. Past it a write fails with EFBIG instead of raising SIGXFSZ
+static void limitFileSize(rlim_t limit)
+{
+    rlimit limits;
+    getrlimit(RLIMIT_FSIZE, &limits);
+    limits.rlim_cur = limit;
+    setrlimit(RLIMIT_FSIZE, &limits);
+}
+
+static void testWriteFailure(const string& directory)
+{
+    string logPath = directory + "/log.wal";
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, SIG_IGN);
+
+    //under SyncPolicy::Always the failing change itself is refused
+    filesystem::remove_all(directory);
+    map<string, uint64_t> expected;
+    {
+        DurableAVLTree durable;
+        check(durable.open(directory, {DurableAVLTree::SyncPolicy::Always}), "open for write failure");
+        for (size_t i = 0; i < 10; i++)
+        {
+            check(durable.insert(makeKey(i), i), "insert before write failure");
+            expected.emplace(makeKey(i), i);
+        }
+        limitFileSize(filesystem::file_size(logPath));
+        check(!durable.insert("refused", 1), "an insert that cannot be logged is refused");
+        check(!durable.contains("refused"), "a refused insert changes nothing");
+        check(durable.hasFailed(), "a failed write fails the log");
+        setrlimit(RLIMIT_FSIZE, &original);
+
+        //the log is not trusted again until a checkpoint, even though writes would work now
+        check(!durable.remove(makeKey(0)), "a remove after a failure is refused");
+        check(!durable.insert_or_assign(makeKey(1), 100), "an assign after a failure is refused");
+        check(durable.eraseRange(makeKey(0), makeKey(9)) == 0, "an eraseRange after a failure is refused");
+        check(!durable.sync(), "sync reports the failure");
+        check(matches(durable, expected), "refused changes leave the tree as it was");
+    }
+    DurableAVLTree recovered;
+    check(recovered.open(directory, {DurableAVLTree::SyncPolicy::Always}), "open after write failure");
+    check(matches(recovered, expected), "recover every acknowledged change and nothing else");
+
+    //a checkpoint puts what the log missed into the snapshot, and writes are taken again
+    limitFileSize(filesystem::file_size(logPath));
+    check(!recovered.insert("refused", 1), "insert that cannot be logged after reopening");
+    setrlimit(RLIMIT_FSIZE, &original);
+    check(recovered.checkpoint(), "checkpoint after write failure");
+    check(!recovered.hasFailed(), "checkpoint clears the failure");
+    check(recovered.insert("accepted", 2), "insert after checkpoint");
+    expected.emplace("accepted", 2);
+    recovered.close();
+    check(recovered.open(directory), "open after checkpoint");
+    check(matches(recovered, expected), "recover after checkpoint");
+    recovered.close();
+
+    //under SyncPolicy::Interval a record is written later, so the failure shows in sync and the changes after it
+    filesystem::remove_all(directory);
+    DurableAVLTree buffered;
+    check(buffered.open(directory, {DurableAVLTree::SyncPolicy::Interval}), "open buffered log");
+    limitFileSize(filesystem::file_size(logPath));
+    buffered.insert("buffered", 1);
+    check(!buffered.sync(), "sync reports a failed write of a buffered record");
+    check(!buffered.insert("after", 2) && !buffered.contains("after"), "an insert after a failed write is refused");
+    setrlimit(RLIMIT_FSIZE, &original);
+    buffered.close();
+    signal(SIGXFSZ, SIG_DFL);
+}
+
+int main(int argc, char* argv[])
+{
+    filesystem::path directory = argc > 1 ? filesystem::path(argv[1]) : filesystem::temp_directory_path() / "avltree_durability_test";
+
+    testReplay(directory.string());
+    testCheckpoint(directory.string());
+    testWriteFailure(directory.string());
+
+    filesystem::remove_all(directory);
+    return testResult();
+}
@@ -0,0 +1,107 @@
+/**
+ * AVLTreeFormat.h
+ *
+ * Layout of the binary snapshot file written by AVLTree::save and read by AVLTree::load and MappedAVLTree.
+ *
+ *   FileHeader                       fixed size, see below
+ *   records, in ascending key order  each one is a uint64 value, a uint32 key length and the key bytes
+ *   padding                          zero bytes up to the next multiple of 8
+ *   index                            one uint64 per record: the offset of the record from the start of the file
+ *
+ * All integers are little-endian. The checksum covers every byte after the header,
+ * so a truncated or damaged file is rejected before any of it is used.
+ */
+
+#ifndef AVLTREEFORMAT_H
+#define AVLTREEFORMAT_H
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace AVLTreeFormat {
+
+    //integers are written in the host's byte order, which has to be the little-endian order of the format.
+    //WriteAheadLog writes its records the same way and relies on this check
+    static_assert(std::endian::native == std::endian::little, "the snapshot and log formats are only implemented for little-endian hosts");
+
+    //"AVLTREE" plus a terminating zero
+    constexpr char MAGIC[8] = {'A', 'V', 'L', 'T', 'R', 'E', 'E', '\0'};
+    constexpr uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        //zero in this version
+        uint32_t reserved;
+        //number of records
+        uint64_t count;
+        //offset of the index from the start of the file
+        uint64_t indexOffset;
+        //total file size, to detect truncation
+        uint64_t fileSize;
+        //FNV-1a of every byte after the header
+        uint64_t checksum;
+    };
+
+    //size of the fixed part of a record, before the key bytes
+    constexpr size_t RECORD_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+
+    //64-bit FNV-1a. Passing the previous result as seed continues a checksum over several buffers
+    inline uint64_t checksum(const char* data, size_t length, uint64_t seed = 0xcbf29ce484222325ull)
+    {
+        uint64_t hash = seed;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    //reads an integer from a position that may not be aligned
+    template <class Integer>
+    inline Integer readInteger(const char* data)
+    {
+        Integer value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    //reads record i through the index. Returns false if the index points outside the record area,
+    //so a file that passed its checksum but was written wrongly still cannot cause an out-of-bounds read
+    inline bool readRecord(const char* file, const FileHeader& header, uint64_t i, std::string_view& key, uint64_t& value)
+    {
+        uint64_t offset = readInteger<uint64_t>(file + header.indexOffset + i * sizeof(uint64_t));
+        if (offset < sizeof(FileHeader) || offset > header.indexOffset - RECORD_HEADER_SIZE)
+        {
+            return false;
+        }
+        uint32_t keyLength = readInteger<uint32_t>(file + offset + sizeof(uint64_t));
+        if (keyLength > header.indexOffset - offset - RECORD_HEADER_SIZE)
+        {
+            return false;
+        }
+        value = readInteger<uint64_t>(file + offset);
+        key = std::string_view(file + offset + RECORD_HEADER_SIZE, keyLength);
+        return true;
+    }
+
+    //checks the parts of the header that do not need the rest of the file. The checksum does not cover the
+    //header, so every bound is checked in an order where none of the arithmetic can wrap
+    inline bool headerIsValid(const FileHeader& header, uint64_t fileSize)
+    {
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+            && header.version == VERSION
+            && header.reserved == 0
+            && header.fileSize == fileSize
+            && header.indexOffset >= sizeof(FileHeader)
+            && header.indexOffset % sizeof(uint64_t) == 0
+            && header.indexOffset <= fileSize
+            && header.count <= (fileSize - header.indexOffset) / sizeof(uint64_t)
+            && header.indexOffset + header.count * sizeof(uint64_t) == fileSize;
+    }
+}
+
+#endif //AVLTREEFORMAT_H
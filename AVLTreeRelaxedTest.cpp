@@ -0,0 +1,259 @@
+/*
+Test for AVLTree's relaxed balance mode.
+Makes random changes to a relaxed tree and a std::map side by side, and checks the tree with isValid, which
+covers heights, sizes, the slack and the marks for rebalance, and against the map. Heights are checked
+against the fewest keys a tree of that height can hold. Then rebalances with small budgets, checking the
+tree after every step, and runs split, eraseRange and the set operations on trees that still have nodes
+marked for rebalance, along with copies that share their nodes.
+
+usage: AVLTreeRelaxedTest [seeds]
+ */
+#include "AVLTree.h"
+#include "TestSupport.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+//the fewest keys a tree of each height can hold when the heights of a node's subtrees differ by at most slack
+static vector<uint64_t> minimumSizes(int slack)
+{
+    vector<uint64_t> sizes = {1};
+    while (sizes.size() < 100)
+    {
+        size_t height = sizes.size();
+        uint64_t shorter = height > static_cast<size_t>(slack) ? sizes[height - 1 - slack] : 0;
+        sizes.push_back(1 + sizes[height - 1] + shorter);
+    }
+    return sizes;
+}
+
+static const vector<uint64_t> AVL_SIZES = minimumSizes(1);
+static const vector<uint64_t> RELAXED_SIZES = minimumSizes(2);
+
+//checks the structure, the height against the size, and every key and value against the map
+static void checkTree(const AVLTree& tree, const map<string, size_t>& expected, const string& what)
+{
+    check(tree.isValid(), what + ": isValid");
+    const vector<uint64_t>& sizes = tree.isRelaxedBalance() ? RELAXED_SIZES : AVL_SIZES;
+    check(tree.size() == 0 || tree.size() >= sizes[tree.getHeight()], what + ": height " + to_string(tree.getHeight()) + " for " + to_string(tree.size()) + " keys");
+    check(tree.size() == expected.size(), what + ": size");
+    auto it = expected.begin();
+    for (auto [key, value] : tree)
+    {
+        if (it == expected.end() || key != it->first || value != it->second)
+        {
+            check(false, what + ": contents at " + key);
+            return;
+        }
+        ++it;
+    }
+}
+
+//true if the tree has nodes marked for rebalance. A budget of 0 changes nothing
+static bool hasMarkedNodes(AVLTree& tree)
+{
+    return !tree.rebalance(0);
+}
+
+//fills a relaxed tree with runs of ascending and descending keys, which leave the most nodes out of AVL balance
+static void fill(AVLTree& tree, map<string, size_t>& expected, mt19937_64& rng, size_t count, size_t keySpace)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t start = rng() % keySpace;
+        size_t run = 1 + rng() % 32;
+        bool descending = rng() % 2 == 0;
+        for (size_t j = 0; j < run && i < count; j++, i++)
+        {
+            size_t k = descending ? (start + keySpace - j) % keySpace : (start + j) % keySpace;
+            if (tree.insert(makeKey(k), i))
+            {
+                expected.emplace(makeKey(k), i);
+            }
+        }
+        if (rng() % 4 == 0)
+        {
+            string key = makeKey(rng() % keySpace);
+            check(tree.remove(key) == (expected.erase(key) == 1), "remove " + key);
+        }
+    }
+}
+
+static void testRandomChanges(uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    string name = "seed " + to_string(seed);
+    AVLTree tree;
+    tree.setRelaxedBalance(true);
+    map<string, size_t> expected;
+    size_t keySpace = 200 + rng() % 4000;
+    for (size_t step = 0; step < 4000; step++)
+    {
+        string key = makeKey(rng() % keySpace);
+        switch (rng() % 8)
+        {
+            case 0:
+            case 1:
+            case 2:
+                check(tree.insert(key, step) == expected.emplace(key, step).second, name + ": insert " + key);
+                break;
+            case 3:
+            case 4:
+                check(tree.remove(key) == (expected.erase(key) == 1), name + ": remove " + key);
+                break;
+            case 5:
+                check(tree.insert_or_assign(key, step) == expected.insert_or_assign(key, step).second, name + ": insert_or_assign " + key);
+                break;
+            case 6:
+                tree[key] = step;
+                expected[key] = step;
+                break;
+            default:
+                tree.rebalance(rng() % 4);
+                break;
+        }
+        if (step % 64 == 0)
+        {
+            checkTree(tree, expected, name + ", step " + to_string(step));
+        }
+    }
+    checkTree(tree, expected, name);
+}
+
+//rebalances a little at a time. Every step has to leave a valid tree with the same contents, and the steps have to finish
+static void testBudgets(uint64_t seed)
+{
+    const size_t budgets[] = {1, 2, 3, 5, 8, 64};
+    for (size_t budget : budgets)
+    {
+        mt19937_64 rng(seed);
+        string name = "seed " + to_string(seed) + ", budget " + to_string(budget);
+        AVLTree tree;
+        tree.setRelaxedBalance(true);
+        map<string, size_t> expected;
+        fill(tree, expected, rng, 3000, 5000);
+        check(hasMarkedNodes(tree), name + ": runs of keys leave nodes marked");
+
+        AVLTree snapshot(tree);
+        map<string, size_t> snapshotExpected = expected;
+        size_t steps = 0;
+        while (!tree.rebalance(budget) && steps <= expected.size())
+        {
+            steps++;
+            checkTree(tree, expected, name + ", step " + to_string(steps));
+        }
+        check(steps <= expected.size(), name + ": rebalancing finishes");
+        check(!hasMarkedNodes(tree), name + ": nothing is left marked");
+        tree.setRelaxedBalance(false);
+        checkTree(tree, expected, name + ", in AVL balance");
+        checkTree(snapshot, snapshotExpected, name + ", a copy taken before rebalancing");
+    }
+}
+
+//each operation gets a tree and an operand that both still have marked nodes, and a copy of each that must not change
+static void testOperations(uint64_t seed)
+{
+    const size_t OPERATIONS = 7;
+    for (size_t operation = 0; operation < OPERATIONS; operation++)
+    {
+        mt19937_64 rng(seed * OPERATIONS + operation);
+        string name = "seed " + to_string(seed) + ", operation " + to_string(operation);
+        AVLTree tree;
+        AVLTree other;
+        tree.setRelaxedBalance(true);
+        other.setRelaxedBalance(true);
+        map<string, size_t> expected;
+        map<string, size_t> otherExpected;
+        fill(tree, expected, rng, 2000, 3000);
+        fill(other, otherExpected, rng, 1000, 3000);
+        check(hasMarkedNodes(tree) && hasMarkedNodes(other), name + ": both trees have marked nodes");
+        AVLTree treeCopy(tree);
+        AVLTree otherCopy(other);
+        map<string, size_t> treeCopyExpected = expected;
+
+        string low = makeKey(rng() % 3000);
+        string high = makeKey(rng() % 3000);
+        if (high < low)
+        {
+            swap(low, high);
+        }
+        switch (operation)
+        {
+            case 0:
+            {
+                AVLTree upper = tree.split(low);
+                map<string, size_t> upperExpected(expected.lower_bound(low), expected.end());
+                expected.erase(expected.lower_bound(low), expected.end());
+                check(upper.isRelaxedBalance(), name + ": the upper half of a split stays relaxed");
+                checkTree(upper, upperExpected, name + ", upper half of split");
+                break;
+            }
+            case 1:
+            {
+                size_t erased = 0;
+                for (auto it = expected.lower_bound(low); it != expected.end() && it->first <= high; erased++)
+                {
+                    it = expected.erase(it);
+                }
+                check(tree.eraseRange(low, high) == erased, name + ": eraseRange count");
+                break;
+            }
+            case 2:
+                tree.unionWith(other);
+                expected.insert(otherExpected.begin(), otherExpected.end());
+                break;
+            case 3:
+                tree.intersectWith(other);
+                for (auto it = expected.begin(); it != expected.end();)
+                {
+                    it = otherExpected.count(it->first) == 0 ? expected.erase(it) : next(it);
+                }
+                break;
+            case 4:
+                tree.differenceWith(other);
+                for (const auto& [key, value] : otherExpected)
+                {
+                    expected.erase(key);
+                }
+                break;
+            case 5:
+            {
+                auto keep = [](const string& key, const size_t& value) { return (key.back() + value) % 3 != 0; };
+                size_t removed = 0;
+                for (auto it = expected.begin(); it != expected.end();)
+                {
+                    it = keep(it->first, it->second) ? next(it) : (removed++, expected.erase(it));
+                }
+                check(tree.filter(keep) == removed, name + ": filter count");
+                break;
+            }
+            default:
+                //a copy that rebalances part of the way, then changes, while the original keeps relaxing
+                treeCopy.rebalance(16);
+                treeCopy.insert("extra", 1);
+                treeCopyExpected.emplace("extra", 1);
+                fill(tree, expected, rng, 500, 3000);
+                break;
+        }
+        checkTree(tree, expected, name);
+        checkTree(other, otherExpected, name + ", operand");
+        checkTree(treeCopy, treeCopyExpected, name + ", copy of the tree");
+        checkTree(otherCopy, otherExpected, name + ", copy of the operand");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t seeds = argc > 1 ? stoul(argv[1]) : 4;
+    for (uint64_t seed = 0; seed < seeds; seed++)
+    {
+        testRandomChanges(seed);
+        testBudgets(seed);
+        testOperations(seed);
+    }
+    return testResult();
+}
@@ -0,0 +1,99 @@
+/*
+Benchmark for AVLTree::remove.
+Builds a tree, then removes every key in a given order and reports the average cost per remove.
+Random order removes many nodes with two children, which is the case that walks to the
+in-order successor. Built with AVLTREE_STATS it also prints comparisons and rotations per remove.
+The last run removes the same keys with eraseRange, a range of 1000 keys at a time.
+
+usage: AVLTreeRemoveBench [number of keys]
+ */
+#include "AVLTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+//makes fixed-width keys so string order matches numeric order
+static vector<string> makeKeys(size_t count)
+{
+    vector<string> keys;
+    keys.reserve(count);
+    char buffer[32];
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "key/%010zu", i);
+        keys.emplace_back(buffer);
+    }
+    return keys;
+}
+
+//inserts the keys in insertOrder, removes them in removeOrder and prints the time per remove
+static void run(const string& name, const vector<string>& insertOrder, const vector<string>& removeOrder)
+{
+    AVLTree tree;
+    for (size_t i = 0; i < insertOrder.size(); i++)
+    {
+        tree.insert(insertOrder[i], i);
+    }
+
+    tree.resetStats();
+    auto start = chrono::steady_clock::now();
+    size_t removed = 0;
+    for (const string& key : removeOrder)
+    {
+        removed += tree.remove(key);
+    }
+    auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    double removes = removeOrder.size();
+    cout << name << ": " << removed << " removes, " << elapsed / removes << " ns/remove";
+#ifdef AVLTREE_STATS
+    AVLTree::Stats stats = tree.stats();
+    cout << ", " << stats.comparisons / removes << " comparisons/remove, "
+         << (stats.singleRotations + stats.doubleRotations) / removes << " rotations/remove";
+#endif
+    cout << endl;
+}
+
+//removes sorted keys with one eraseRange call per chunk of keys and prints the time per removed key
+static void runEraseRange(const vector<string>& insertOrder, const vector<string>& sorted, size_t chunk)
+{
+    AVLTree tree;
+    for (size_t i = 0; i < insertOrder.size(); i++)
+    {
+        tree.insert(insertOrder[i], i);
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t removed = 0;
+    for (size_t i = 0; i < sorted.size(); i += chunk)
+    {
+        removed += tree.eraseRange(sorted[i], sorted[min(i + chunk, sorted.size()) - 1]);
+    }
+    auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    cout << "random insert, eraseRange of " << chunk << " keys: " << removed << " removes, "
+         << elapsed / sorted.size() << " ns/remove" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? stoul(argv[1]) : 1000000;
+
+    vector<string> sorted = makeKeys(count);
+    vector<string> shuffled = sorted;
+    mt19937_64 rng(42);
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+    vector<string> reversed(sorted.rbegin(), sorted.rend());
+
+    run("random insert, random remove", shuffled, shuffled);
+    run("random insert, sorted remove", shuffled, sorted);
+    run("sorted insert, reverse remove", sorted, reversed);
+    runEraseRange(shuffled, sorted, 1000);
+
+    return 0;
+}
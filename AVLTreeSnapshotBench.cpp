@@ -0,0 +1,115 @@
+/*
+Benchmark for the binary snapshot format.
+Compares rebuilding a tree by inserting every key with AVLTree::load, and with MappedAVLTree::open,
+then times random get() calls on the loaded tree and on the mapped file.
+Every loaded or mapped key is checked against the original tree.
+
+usage: AVLTreeSnapshotBench [number of keys] [snapshot path]
+ */
+#include "AVLTree.h"
+#include "MappedAVLTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+//makes fixed-width keys so string order matches numeric order
+static string makeKey(size_t i)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "key/%010zu", i);
+    return buffer;
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//times random lookups on any container with get() and returns the number of keys found
+template <class Tree>
+static size_t timeLookups(const string& name, const Tree& tree, const vector<string>& keys)
+{
+    mt19937_64 rng(7);
+    size_t lookups = keys.size();
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        found += tree.get(keys[rng() % keys.size()]).has_value();
+    }
+    cout << name << ": " << millisecondsSince(start) * 1e6 / lookups << " ns/get" << endl;
+    return found;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = max<size_t>(argc > 1 ? stoul(argv[1]) : 1000000, 1);
+    string path = argc > 2 ? argv[2] : "avltree_snapshot.bin";
+
+    vector<string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        keys.push_back(makeKey(i));
+    }
+    vector<string> shuffled = keys;
+    mt19937_64 rng(42);
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    auto start = chrono::steady_clock::now();
+    AVLTree original;
+    for (size_t i = 0; i < count; i++)
+    {
+        original.insert(shuffled[i], i);
+    }
+    cout << "insert " << count << " keys: " << millisecondsSince(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    if (!original.save(path))
+    {
+        cerr << "could not save " << path << endl;
+        return 1;
+    }
+    cout << "save: " << millisecondsSince(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    AVLTree loaded;
+    if (!loaded.load(path))
+    {
+        cerr << "could not load " << path << endl;
+        return 1;
+    }
+    cout << "load: " << millisecondsSince(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    MappedAVLTree mapped;
+    if (!mapped.open(path))
+    {
+        cerr << "could not map " << path << endl;
+        return 1;
+    }
+    cout << "map and verify: " << millisecondsSince(start) << " ms" << endl;
+
+    //checks both copies against the original
+    size_t mismatches = loaded.size() != original.size() || mapped.size() != original.size();
+    for (const string& key : keys)
+    {
+        optional<size_t> expected = original.get(key);
+        mismatches += loaded.get(key) != expected;
+        mismatches += mapped.get(key) != expected;
+    }
+    mismatches += mapped.findRange(keys[count / 4], keys[count / 2]) != original.findRange(keys[count / 4], keys[count / 2]);
+    cout << "mismatches: " << mismatches << endl;
+
+    timeLookups("loaded AVLTree", loaded, keys);
+    timeLookups("MappedAVLTree", mapped, keys);
+
+    mapped.close();
+    std::remove(path.c_str());
+    return mismatches == 0 ? 0 : 1;
+}
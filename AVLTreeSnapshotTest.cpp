@@ -0,0 +1,95 @@
+/*
+Test for the binary snapshot format.
+Saves a tree, checks that AVLTree::load and MappedAVLTree::open read it back, then damages copies of the
+file in ways the checksum does not catch, such as a header whose offsets wrap around, and checks that
+both readers reject them.
+
+usage: AVLTreeSnapshotTest [directory]
+ */
+#include "AVLTree.h"
+#include "AVLTreeFormat.h"
+#include "MappedAVLTree.h"
+#include "TestSupport.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+using namespace std;
+using namespace TestSupport;
+
+//writes contents with its header replaced, and checks that neither reader accepts the file
+static void checkRejected(const string& path, string contents, const AVLTreeFormat::FileHeader& header, const string& what)
+{
+    memcpy(contents.data(), &header, sizeof(header));
+    writeFile(path, contents);
+    AVLTree loaded;
+    loaded.insert("untouched", 1);
+    check(!loaded.load(path), "load rejects " + what);
+    check(loaded.size() == 1 && loaded.contains("untouched"), "a rejected load leaves the tree as it was, " + what);
+    MappedAVLTree mapped;
+    check(!mapped.open(path), "open rejects " + what);
+    check(!mapped.isOpen(), "a rejected open leaves nothing mapped, " + what);
+}
+
+int main(int argc, char* argv[])
+{
+    filesystem::path directory = argc > 1 ? filesystem::path(argv[1]) : filesystem::temp_directory_path() / "avltree_snapshot_test";
+    filesystem::create_directories(directory);
+    string path = (directory / "snapshot.avl").string();
+    string damagedPath = (directory / "damaged.avl").string();
+
+    AVLTree tree;
+    for (size_t i = 0; i < 1000; i++)
+    {
+        tree.insert(makeKey(i * 7919 % 1000), i);
+    }
+    check(tree.save(path), "save");
+
+    AVLTree loaded;
+    check(loaded.load(path), "load");
+    MappedAVLTree mapped;
+    check(mapped.open(path), "open");
+    for (auto [key, value] : tree)
+    {
+        check(loaded.get(key) == value, "loaded value of " + key);
+        check(mapped.get(key) == value, "mapped value of " + key);
+    }
+    check(loaded.size() == tree.size() && mapped.size() == tree.size(), "sizes after load and open");
+    mapped.close();
+
+    string contents = readFile(path);
+    AVLTreeFormat::FileHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    uint64_t fileSize = contents.size();
+
+    //an index past the end of the file, with a count that makes indexOffset + count * 8 wrap back to fileSize
+    AVLTreeFormat::FileHeader damaged = header;
+    damaged.indexOffset = fileSize + sizeof(uint64_t);
+    damaged.count = (UINT64_MAX - sizeof(uint64_t) + 1) / sizeof(uint64_t);
+    checkRejected(damagedPath, contents, damaged, "an index offset past the end of the file");
+
+    damaged = header;
+    damaged.count = header.count + 1;
+    checkRejected(damagedPath, contents, damaged, "a count the index does not fit");
+
+    damaged = header;
+    damaged.indexOffset = sizeof(AVLTreeFormat::FileHeader) - sizeof(uint64_t);
+    checkRejected(damagedPath, contents, damaged, "an index offset inside the header");
+
+    damaged = header;
+    damaged.fileSize = fileSize + 1;
+    checkRejected(damagedPath, contents, damaged, "a file size that does not match");
+
+    //a truncated file fails the size check, and a changed byte after the header fails the checksum
+    writeFile(damagedPath, contents.substr(0, contents.size() - 1));
+    check(!loaded.load(damagedPath), "load rejects a truncated file");
+    check(!mapped.open(damagedPath), "open rejects a truncated file");
+    string flipped = contents;
+    flipped[sizeof(AVLTreeFormat::FileHeader) + 2] ^= 1;
+    writeFile(damagedPath, flipped);
+    check(!loaded.load(damagedPath), "load rejects a damaged record");
+    check(!mapped.open(damagedPath), "open rejects a damaged record");
+
+    filesystem::remove_all(directory);
+    return testResult();
+}
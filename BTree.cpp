@@ -0,0 +1,638 @@
+#include "BTree.h"
+#include "KeyCompare.h"
+
+#include <algorithm>
+#include <iterator>
+
+//default constructor. The first insert creates the root leaf
+BTree::BTree()
+{
+    root = nullptr;
+    treeSize = 0;
+    levels = 0;
+}
+
+//copy constructor that copies every node and relinks the copied leaves
+BTree::BTree(const BTree& other)
+{
+    LeafNode* lastLeaf = nullptr;
+    root = other.root != nullptr ? copy(other.root, lastLeaf) : nullptr;
+    treeSize = other.treeSize;
+    levels = other.levels;
+}
+
+//the unused slots get a prefix above every key, so the counting loops in lowerBound and upperBound can run over all of them
+BTree::Node::Node(bool leaf)
+{
+    this->leaf = leaf;
+    std::fill(std::begin(prefixes), std::end(prefixes), UNUSED_PREFIX);
+}
+
+BTree::LeafNode::LeafNode() : Node(true)
+{
+}
+
+BTree::InnerNode::InnerNode() : Node(false)
+{
+}
+
+//Inserts a new key-value pair. A key that is already in the tree keeps its value
+bool BTree::insert(const std::string& key, size_t value)
+{
+    bool inserted;
+    findOrInsert(key, value, inserted);
+    return inserted;
+}
+
+//Public call for the recursive remove. An inner root left with a single child is replaced by that child
+bool BTree::remove(std::string_view key)
+{
+    if (root == nullptr || !remove(root, key))
+    {
+        return false;
+    }
+    treeSize--;
+
+    if (root->count == 0)
+    {
+        Node* oldRoot = root;
+        root = root->leaf ? nullptr : static_cast<InnerNode*>(root)->children[0];
+        levels--;
+        if (oldRoot->leaf)
+        {
+            delete static_cast<LeafNode*>(oldRoot);
+        }else
+        {
+            delete static_cast<InnerNode*>(oldRoot);
+        }
+    }
+    return true;
+}
+
+//searches the tree for a given key
+bool BTree::contains(std::string_view key) const
+{
+    return get(key).has_value();
+}
+
+//walks down to the only leaf that can hold the key and searches it
+optional<size_t> BTree::get(std::string_view key) const
+{
+    if (root == nullptr)
+    {
+        return nullopt;
+    }
+    const LeafNode* leaf = findLeaf(key);
+    size_t i = lowerBound(leaf, key);
+    if (i < leaf->count && leaf->keys[i] == key)
+    {
+        return leaf->values[i];
+    }
+    return nullopt;
+}
+
+//returns the value of the key, inserting it with a value of 0 if it is missing
+size_t& BTree::operator[](std::string_view key)
+{
+    bool inserted;
+    return *findOrInsert(key, 0, inserted);
+}
+
+//finds the first key in the range, then follows the leaf list until a key is above the range
+vector<size_t> BTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    vector<size_t> values;
+    if (root == nullptr)
+    {
+        return values;
+    }
+    const LeafNode* leaf = findLeaf(lowKey);
+    for (size_t i = lowerBound(leaf, lowKey); leaf != nullptr; leaf = leaf->next, i = 0)
+    {
+        for (; i < leaf->count; i++)
+        {
+            if (leaf->keys[i] > highKey)
+            {
+                return values;
+            }
+            values.push_back(leaf->values[i]);
+        }
+    }
+    return values;
+}
+
+//the leaves hold every key in order, so listing them needs no recursion
+std::vector<std::string> BTree::keys() const
+{
+    vector<string> keyVector;
+    keyVector.reserve(treeSize);
+    for (const LeafNode* leaf = firstLeaf(); leaf != nullptr; leaf = leaf->next)
+    {
+        keyVector.insert(keyVector.end(), leaf->keys, leaf->keys + leaf->count);
+    }
+    return keyVector;
+}
+
+//returns how many pairs are in the tree
+size_t BTree::size() const
+{
+    return treeSize;
+}
+
+//every leaf is on the same level, so the height is the number of levels below the root
+size_t BTree::getHeight() const
+{
+    return levels > 0 ? levels - 1 : 0;
+}
+
+//= operator override that replaces the tree with a copy of another tree
+void BTree::operator=(const BTree& other)
+{
+    //checks for self-assignment
+    if (this == &other)
+    {
+        return;
+    }
+    clear(root);
+    LeafNode* lastLeaf = nullptr;
+    root = other.root != nullptr ? copy(other.root, lastLeaf) : nullptr;
+    treeSize = other.treeSize;
+    levels = other.levels;
+}
+
+//class destructor
+BTree::~BTree()
+{
+    clear(root);
+}
+
+//the bytes go in from the most significant end, so comparing prefixes as integers
+//compares the bytes in order, as unsigned chars like std::string does
+uint64_t BTree::keyPrefix(std::string_view key)
+{
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < sizeof(prefix); i++)
+    {
+        prefix <<= 8;
+        if (i < key.size())
+        {
+            prefix |= static_cast<unsigned char>(key[i]);
+        }
+    }
+    return prefix;
+}
+
+//only the keys with an equal prefix are left for a binary search with full comparisons
+size_t BTree::lowerBound(const Node* node, std::string_view key)
+{
+    size_t low;
+    size_t high;
+    equalPrefixRange(node, key, low, high);
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (node->keys[middle] < key)
+        {
+            low = middle + 1;
+        }else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+size_t BTree::upperBound(const Node* node, std::string_view key)
+{
+    size_t low;
+    size_t high;
+    equalPrefixRange(node, key, low, high);
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (node->keys[middle] <= key)
+        {
+            low = middle + 1;
+        }else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+//a key that differs from the node's shared bytes is below or above all of its keys. Otherwise every key whose
+//prefix is smaller than the search key's is below it, and every key whose prefix is larger is above it.
+//Both are counted over the whole node without branches, which the compiler vectorizes
+void BTree::equalPrefixRange(const Node* node, std::string_view key, size_t& low, size_t& high)
+{
+    std::string_view shared = std::string_view(node->keys[0]).substr(0, node->sharedLength);
+    int comparison = key.substr(0, shared.size()).compare(shared);
+    if (comparison != 0)
+    {
+        low = comparison < 0 ? 0 : node->count;
+        high = low;
+        return;
+    }
+
+    uint64_t prefix = keyPrefix(key.substr(shared.size()));
+    low = 0;
+    high = 0;
+    for (size_t i = 0; i < MAX_KEYS; i++)
+    {
+        low += node->prefixes[i] < prefix;
+        high += node->prefixes[i] <= prefix;
+    }
+    //a key whose prefix is UNUSED_PREFIX also counts the unused slots
+    high = min(high, node->count);
+}
+
+//a key equal to a separator is in the subtree to the right of it, hence upperBound
+const BTree::LeafNode* BTree::findLeaf(std::string_view key) const
+{
+    const Node* node = root;
+    while (!node->leaf)
+    {
+        node = static_cast<const InnerNode*>(node)->children[upperBound(node, key)];
+    }
+    return static_cast<const LeafNode*>(node);
+}
+
+//inserts below the root, then puts a new root above the two halves if the root split
+BTree::ValueType* BTree::findOrInsert(std::string_view key, ValueType value, bool& inserted)
+{
+    if (root == nullptr)
+    {
+        root = new LeafNode();
+        levels = 1;
+    }
+
+    ValueType* slot;
+    Split split = insert(root, key, value, slot, inserted);
+    if (split.right != nullptr)
+    {
+        InnerNode* newRoot = new InnerNode();
+        newRoot->children[0] = root;
+        newRoot->children[1] = split.right;
+        insertKey(newRoot, 0, std::move(split.separator));
+        root = newRoot;
+        levels++;
+    }
+    if (inserted)
+    {
+        treeSize++;
+    }
+    return slot;
+}
+
+//a full node is split in half before the new key goes into the half it belongs to,
+//and the parent gets the new right half and the key that separates it from the left one
+BTree::Split BTree::insert(Node* node, std::string_view key, ValueType value, ValueType*& slot, bool& inserted)
+{
+    Split split;
+    if (node->leaf)
+    {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        size_t i = lowerBound(leaf, key);
+        //duplicate key found
+        if (i < leaf->count && leaf->keys[i] == key)
+        {
+            inserted = false;
+            slot = &leaf->values[i];
+            return split;
+        }
+
+        //the upper half moves to a new leaf after this one in the leaf list
+        if (leaf->count == MAX_KEYS)
+        {
+            LeafNode* right = new LeafNode();
+            size_t half = MAX_KEYS / 2;
+            for (size_t j = half; j < MAX_KEYS; j++)
+            {
+                moveKey(leaf, j, right, j - half);
+                right->values[j - half] = leaf->values[j];
+            }
+            right->count = MAX_KEYS - half;
+            leaf->count = half;
+            right->next = leaf->next;
+            leaf->next = right;
+            refreshPrefixes(leaf);
+            refreshPrefixes(right);
+            split.right = right;
+            if (i > half)
+            {
+                leaf = right;
+                i -= half;
+            }
+        }
+
+        std::copy_backward(leaf->values + i, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->values[i] = value;
+        insertKey(leaf, i, std::string(key));
+        inserted = true;
+        slot = &leaf->values[i];
+        if (split.right != nullptr)
+        {
+            split.separator = split.right->keys[0];
+        }
+        return split;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    size_t i = upperBound(inner, key);
+    Split childSplit = insert(inner->children[i], key, value, slot, inserted);
+    if (childSplit.right == nullptr)
+    {
+        return split;
+    }
+
+    //the middle separator moves up to the parent, and the separators and children after it to the new node
+    if (inner->count == MAX_KEYS)
+    {
+        InnerNode* right = new InnerNode();
+        size_t middle = MAX_KEYS / 2;
+        for (size_t j = middle + 1; j < MAX_KEYS; j++)
+        {
+            moveKey(inner, j, right, j - middle - 1);
+        }
+        std::copy(inner->children + middle + 1, inner->children + MAX_KEYS + 1, right->children);
+        right->count = MAX_KEYS - middle - 1;
+        split.separator = std::move(inner->keys[middle]);
+        inner->prefixes[middle] = UNUSED_PREFIX;
+        inner->count = middle;
+        refreshPrefixes(inner);
+        refreshPrefixes(right);
+        split.right = right;
+        if (i > middle)
+        {
+            inner = right;
+            i -= middle + 1;
+        }
+    }
+
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+    inner->children[i + 1] = childSplit.right;
+    insertKey(inner, i, std::move(childSplit.separator));
+    return split;
+}
+
+//separators are only bounds, so a removed key can stay behind as one
+bool BTree::remove(Node* node, std::string_view key)
+{
+    if (node->leaf)
+    {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        size_t i = lowerBound(leaf, key);
+        //key is not in the tree
+        if (i == leaf->count || leaf->keys[i] != key)
+        {
+            return false;
+        }
+        std::copy(leaf->values + i + 1, leaf->values + leaf->count, leaf->values + i);
+        eraseKey(leaf, i);
+        return true;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    size_t i = upperBound(inner, key);
+    if (!remove(inner->children[i], key))
+    {
+        return false;
+    }
+    if (inner->children[i]->count < MIN_KEYS)
+    {
+        fixChild(inner, i);
+    }
+    return true;
+}
+
+//borrowing keeps both siblings, so it is tried first. Two siblings that cannot lend have at most
+//2 * MIN_KEYS keys between them, plus the separator for inner nodes, which fits in one node
+void BTree::fixChild(InnerNode* node, size_t i)
+{
+    Node* child = node->children[i];
+    Node* left = i > 0 ? node->children[i - 1] : nullptr;
+    Node* right = i < node->count ? node->children[i + 1] : nullptr;
+
+    if (left != nullptr && left->count > MIN_KEYS)
+    {
+        //the left sibling's last key moves over. For leaves the separator becomes the child's new first key,
+        //for inner nodes the separator moves down and the sibling's last key takes its place
+        if (child->leaf)
+        {
+            LeafNode* to = static_cast<LeafNode*>(child);
+            LeafNode* from = static_cast<LeafNode*>(left);
+            std::copy_backward(to->values, to->values + to->count, to->values + to->count + 1);
+            to->values[0] = from->values[from->count - 1];
+            insertKey(to, 0, std::move(from->keys[from->count - 1]));
+            eraseKey(from, from->count - 1);
+            setKey(node, i - 1, std::string(to->keys[0]));
+            refreshPrefixes(node);
+        }else
+        {
+            InnerNode* to = static_cast<InnerNode*>(child);
+            InnerNode* from = static_cast<InnerNode*>(left);
+            std::copy_backward(to->children, to->children + to->count + 1, to->children + to->count + 2);
+            to->children[0] = from->children[from->count];
+            insertKey(to, 0, std::move(node->keys[i - 1]));
+            setKey(node, i - 1, std::move(from->keys[from->count - 1]));
+            refreshPrefixes(node);
+            eraseKey(from, from->count - 1);
+        }
+    }
+    else if (right != nullptr && right->count > MIN_KEYS)
+    {
+        //the mirror image: the right sibling's first key moves over
+        if (child->leaf)
+        {
+            LeafNode* to = static_cast<LeafNode*>(child);
+            LeafNode* from = static_cast<LeafNode*>(right);
+            to->values[to->count] = from->values[0];
+            insertKey(to, to->count, std::move(from->keys[0]));
+            std::copy(from->values + 1, from->values + from->count, from->values);
+            eraseKey(from, 0);
+            setKey(node, i, std::string(from->keys[0]));
+            refreshPrefixes(node);
+        }else
+        {
+            InnerNode* to = static_cast<InnerNode*>(child);
+            InnerNode* from = static_cast<InnerNode*>(right);
+            to->children[to->count + 1] = from->children[0];
+            insertKey(to, to->count, std::move(node->keys[i]));
+            setKey(node, i, std::move(from->keys[0]));
+            refreshPrefixes(node);
+            std::copy(from->children + 1, from->children + from->count + 1, from->children);
+            eraseKey(from, 0);
+        }
+    }else
+    {
+        //merges the right one of the two siblings into the left one, then drops it and its separator
+        size_t leftIndex = left != nullptr ? i - 1 : i;
+        Node* into = node->children[leftIndex];
+        Node* from = node->children[leftIndex + 1];
+        if (into->leaf)
+        {
+            LeafNode* leafInto = static_cast<LeafNode*>(into);
+            LeafNode* leafFrom = static_cast<LeafNode*>(from);
+            for (size_t j = 0; j < leafFrom->count; j++)
+            {
+                moveKey(leafFrom, j, leafInto, leafInto->count + j);
+                leafInto->values[leafInto->count + j] = leafFrom->values[j];
+            }
+            leafInto->count += leafFrom->count;
+            refreshPrefixes(leafInto);
+            leafInto->next = leafFrom->next;
+            delete leafFrom;
+        }else
+        {
+            InnerNode* innerInto = static_cast<InnerNode*>(into);
+            InnerNode* innerFrom = static_cast<InnerNode*>(from);
+            insertKey(innerInto, innerInto->count, std::move(node->keys[leftIndex]));
+            for (size_t j = 0; j < innerFrom->count; j++)
+            {
+                moveKey(innerFrom, j, innerInto, innerInto->count + j);
+            }
+            std::copy(innerFrom->children, innerFrom->children + innerFrom->count + 1, innerInto->children + innerInto->count);
+            innerInto->count += innerFrom->count;
+            refreshPrefixes(innerInto);
+            delete innerFrom;
+        }
+        std::copy(node->children + leftIndex + 2, node->children + node->count + 1, node->children + leftIndex + 1);
+        eraseKey(node, leftIndex);
+    }
+}
+
+//the key may be shorter than a sharedLength the caller is about to refresh
+void BTree::setKey(Node* node, size_t i, std::string&& key)
+{
+    node->prefixes[i] = keyPrefix(std::string_view(key).substr(min(node->sharedLength, key.size())));
+    node->keys[i] = std::move(key);
+}
+
+void BTree::insertKey(Node* node, size_t i, std::string&& key)
+{
+    for (size_t j = node->count; j > i; j--)
+    {
+        node->keys[j] = std::move(node->keys[j - 1]);
+        node->prefixes[j] = node->prefixes[j - 1];
+    }
+    setKey(node, i, std::move(key));
+    node->count++;
+    refreshPrefixes(node);
+}
+
+//the freed slot gets an empty string, so a long key's memory is not held by an unused slot
+void BTree::eraseKey(Node* node, size_t i)
+{
+    for (size_t j = i; j + 1 < node->count; j++)
+    {
+        node->keys[j] = std::move(node->keys[j + 1]);
+        node->prefixes[j] = node->prefixes[j + 1];
+    }
+    node->count--;
+    node->keys[node->count] = std::string();
+    node->prefixes[node->count] = UNUSED_PREFIX;
+    refreshPrefixes(node);
+}
+
+//the prefix is recomputed, since the other node may share a different number of leading bytes
+void BTree::moveKey(Node* from, size_t i, Node* to, size_t j)
+{
+    setKey(to, j, std::move(from->keys[i]));
+    from->keys[i] = std::string();
+    from->prefixes[i] = UNUSED_PREFIX;
+}
+
+//the keys are sorted, so the bytes the first and last key share are shared by every key in between
+void BTree::refreshPrefixes(Node* node)
+{
+    size_t sharedLength = 0;
+    if (node->count > 1)
+    {
+        const std::string& first = node->keys[0];
+        const std::string& last = node->keys[node->count - 1];
+        sharedLength = KeyCompare::commonPrefixLength(first.data(), last.data(), min(first.size(), last.size()));
+    }
+    if (sharedLength == node->sharedLength)
+    {
+        return;
+    }
+
+    node->sharedLength = sharedLength;
+    for (size_t i = 0; i < node->count; i++)
+    {
+        node->prefixes[i] = keyPrefix(std::string_view(node->keys[i]).substr(sharedLength));
+    }
+}
+
+//recursive method to delete every node below and including node
+void BTree::clear(Node* node)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (node->leaf)
+    {
+        delete static_cast<LeafNode*>(node);
+        return;
+    }
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    for (size_t i = 0; i <= inner->count; i++)
+    {
+        clear(inner->children[i]);
+    }
+    delete inner;
+}
+
+//copies the children from left to right, so the leaves are copied in key order and each one is linked after the last
+BTree::Node* BTree::copy(const Node* node, LeafNode*& lastLeaf)
+{
+    if (node->leaf)
+    {
+        LeafNode* newLeaf = new LeafNode(*static_cast<const LeafNode*>(node));
+        newLeaf->next = nullptr;
+        if (lastLeaf != nullptr)
+        {
+            lastLeaf->next = newLeaf;
+        }
+        lastLeaf = newLeaf;
+        return newLeaf;
+    }
+
+    InnerNode* newInner = new InnerNode(*static_cast<const InnerNode*>(node));
+    for (size_t i = 0; i <= newInner->count; i++)
+    {
+        newInner->children[i] = copy(newInner->children[i], lastLeaf);
+    }
+    return newInner;
+}
+
+const BTree::LeafNode* BTree::firstLeaf() const
+{
+    const Node* node = root;
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+    while (!node->leaf)
+    {
+        node = static_cast<const InnerNode*>(node)->children[0];
+    }
+    return static_cast<const LeafNode*>(node);
+}
+
+//ostream methods
+
+//walks the leaf list, which is already in key order
+ostream& operator<<(std::ostream& os, const BTree& bTree)
+{
+    for (const BTree::LeafNode* leaf = bTree.firstLeaf(); leaf != nullptr; leaf = leaf->next)
+    {
+        for (size_t i = 0; i < leaf->count; i++)
+        {
+            os << "{" + leaf->keys[i] + ": " + to_string(leaf->values[i]) + "}\n";
+        }
+    }
+    return os;
+}
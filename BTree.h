@@ -0,0 +1,231 @@
+/**
+ * BTree.h
+ */
+
+#ifndef BTREE_H
+#define BTREE_H
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ *Ordered map with the same interface as AVLTree, stored as a B+ tree. Each node holds up to MAX_KEYS sorted keys,
+ *so a lookup passes about log16(n) nodes instead of log2(n), and the key-value pairs sit in a linked list of
+ *leaves that findRange and keys walk without going back up the tree.
+ *Besides its keys, every node keeps 8 bytes of each key as a big-endian integer, taken after the leading bytes
+ *all of the node's keys share, so they are the bytes in which its keys differ. A search compares these integers
+ *over the whole node in one branch-free loop the compiler turns into vector compares, and only compares full keys
+ *among the few whose 8 bytes match the search key's.
+ *Nodes are aligned to cache lines. Unlike AVLTree, copies are deep and there is no node pool
+ */
+class BTree {
+public:
+    using KeyType = std::string;
+    using ValueType = size_t;
+
+    /**
+     *default constructor
+     */
+    BTree();
+
+    /**
+     *copy constructor. Copies every node, in O(n)
+     */
+    BTree(const BTree& other);
+
+    /**
+    *Inserts a new key-value pair into the tree. Returns false, and keeps the old value, if the key is already in the tree
+    */
+    bool insert(const std::string& key, size_t value);
+
+    /**
+    *Removes the key if it is in the tree, merging or refilling nodes that become less than half full
+    */
+    bool remove(std::string_view key);
+
+    /**
+    *Returns true if the key is in the tree
+    */
+    bool contains(std::string_view key) const;
+
+    /**
+    *Returns the value of the key, or nothing if the key is not in the tree
+    */
+    optional<size_t> get(std::string_view key) const;
+
+    /**
+    *Returns a reference to the key's value, inserting the key with a value of 0 first if it is missing.
+    *The reference stays valid until the tree is next changed
+    */
+    size_t& operator[](std::string_view key);
+
+    /**
+    *Returns the values of all keys between the two keys (inclusive), in key order
+    */
+    vector<size_t> findRange(std::string_view lowKey, std::string_view highKey) const;
+
+    /**
+    *Returns all keys in the tree, in order
+    */
+    std::vector<std::string> keys() const;
+
+    /**
+    *returns the number of key value pairs in the tree
+    */
+    size_t size() const;
+
+    /**
+    *Returns the height of the tree: the number of levels below the root, so an empty tree and a tree
+    *with a single node both have height 0
+    */
+    size_t getHeight() const;
+
+    /**
+    *= operator overload. Replaces the contents with a copy of the other tree
+    */
+    void operator=(const BTree& other);
+
+    /**
+    *Destructor for the BTree class
+    */
+    ~BTree();
+
+    //keys per node. The prefixes of a full node fill two cache lines
+    static constexpr size_t MAX_KEYS = 16;
+    //every node but the root keeps at least this many keys
+    static constexpr size_t MIN_KEYS = (MAX_KEYS - 1) / 2;
+
+private:
+    //prefix of the unused slots, so they never count as less than a search key
+    static constexpr uint64_t UNUSED_PREFIX = UINT64_MAX;
+
+    /**
+     *Fields shared by both kinds of node. Every key in the node starts with the same sharedLength bytes.
+     *prefixes[i] is the 8 bytes of keys[i] after those, and UNUSED_PREFIX from count on. A leaf holds the key-value pairs. An inner node holds separators: the subtree
+     *children[i] has the keys below keys[i] and not below keys[i - 1]
+     */
+    struct alignas(64) Node {
+        uint64_t prefixes[MAX_KEYS];
+        size_t count = 0;
+        size_t sharedLength = 0;
+        bool leaf;
+        std::string keys[MAX_KEYS];
+
+        explicit Node(bool leaf);
+    };
+
+    struct LeafNode : Node {
+        ValueType values[MAX_KEYS];
+        //next leaf in key order, or null for the last one
+        LeafNode* next = nullptr;
+
+        LeafNode();
+    };
+
+    struct InnerNode : Node {
+        //count + 1 of them are used
+        Node* children[MAX_KEYS + 1];
+
+        InnerNode();
+    };
+
+    //what a node that had to split passes up to its parent: the new node to the right of it,
+    //and the smallest key below that node
+    struct Split {
+        Node* right = nullptr;
+        std::string separator;
+    };
+
+    Node* root;
+    size_t treeSize;
+    //number of levels, 0 for an empty tree
+    size_t levels;
+
+    /**
+     *first 8 bytes of a key as a big-endian integer, padded with zero bytes. Two keys whose prefixes
+     *differ compare the same way as their prefixes
+     */
+    static uint64_t keyPrefix(std::string_view key);
+
+    /**
+     *in-node searches. lowerBound returns the first position whose key is not less than key,
+     *upperBound the first one whose key is greater
+     */
+    static size_t lowerBound(const Node* node, std::string_view key);
+    static size_t upperBound(const Node* node, std::string_view key);
+
+    /**
+     *first step of both searches. Narrows the search to the positions [low, high) whose prefixes equal
+     *the key's, so only those need a full comparison
+     */
+    static void equalPrefixRange(const Node* node, std::string_view key, size_t& low, size_t& high);
+
+    /**
+     *Walks down to the leaf that would hold key
+     */
+    const LeafNode* findLeaf(std::string_view key) const;
+
+    /**
+     *helper for insert and operator[]. Returns the key's value, inserting the key with the given value if it is
+     *missing, and sets inserted accordingly. Grows the tree by a level when the root splits
+     */
+    ValueType* findOrInsert(std::string_view key, ValueType value, bool& inserted);
+
+    /**
+     *recursive helper for findOrInsert. Finds or inserts the key below node and points slot at
+     *its value. Returns a Split if node had to be split to make room
+     */
+    Split insert(Node* node, std::string_view key, ValueType value, ValueType*& slot, bool& inserted);
+
+    /**
+     *recursive helper for remove. Afterwards a child of node may hold fewer than MIN_KEYS keys,
+     *which fixChild repairs before returning
+     */
+    bool remove(Node* node, std::string_view key);
+
+    /**
+     *Brings node->children[i] back to MIN_KEYS keys by moving one key over from a sibling,
+     *or by merging it with a sibling that has none to spare
+     */
+    void fixChild(InnerNode* node, size_t i);
+
+    /**
+     *helpers that keep a node's keys and prefixes in step; callers move values and children themselves.
+     *insertKey opens a slot at position i and eraseKey closes it, and both call refreshPrefixes.
+     *setKey and moveKey, which moves the key at one position to a position in another node, leave
+     *count and refreshPrefixes to the caller
+     */
+    static void setKey(Node* node, size_t i, std::string&& key);
+    static void insertKey(Node* node, size_t i, std::string&& key);
+    static void eraseKey(Node* node, size_t i);
+    static void moveKey(Node* from, size_t i, Node* to, size_t j);
+
+    /**
+     *Recomputes sharedLength after the first or last key of a node may have changed, and every prefix if it did
+     */
+    static void refreshPrefixes(Node* node);
+
+    /**
+     *recursive helpers for the destructor and the copy constructor. copy links the copied leaves in order through lastLeaf
+     */
+    static void clear(Node* node);
+    static Node* copy(const Node* node, LeafNode*& lastLeaf);
+
+    /**
+     *Returns the leftmost leaf, or null for an empty tree
+     */
+    const LeafNode* firstLeaf() const;
+
+    /**
+    *Outputs all pairs in key order in the format "{Key: value}", like AVLTree
+    */
+    friend std::ostream& operator<<(ostream& os, const BTree& bTree);
+};
+
+#endif //BTREE_H
@@ -0,0 +1,179 @@
+/*
+Test for BTree.
+Makes random changes to a BTree and a std::map side by side and checks the tree against the map: every key
+and value through get, contains and keys, findRange over random ranges, and the height against the most
+levels a tree of that size can have. Keys share long leading bytes and are often prefixes of each other or
+differ only past the 8 bytes a node keeps of each key, so searches have to fall back to full key
+comparisons. Copies and assignments must not change when the original does.
+
+usage: BTreeTest [seeds]
+ */
+#include "BTree.h"
+#include "TestSupport.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+//keys from a few families: short ones, ones with a long shared start, and ones that are prefixes of each other
+static string makeTestKey(mt19937_64& rng, size_t keySpace)
+{
+    size_t i = rng() % keySpace;
+    switch (rng() % 4)
+    {
+        case 0:
+            return makeKey(i);
+        case 1:
+            return "a/long/shared/start/of/the/key/" + makeKey(i);
+        case 2:
+            //differs from its neighbours only in the last byte, well past the first 8
+            return "a/long/shared/start/" + string(i % 16, 'x') + char('a' + i % 26);
+        default:
+            return string(1 + i % 20, 'k');
+    }
+}
+
+//the most levels below the root for a tree of size keys: every node but the root holds at least MIN_KEYS keys,
+//and an inner node with k keys has k + 1 children
+static size_t maximumHeight(size_t size)
+{
+    size_t height = 0;
+    //the fewest keys the leaves of a tree of height + 1 can hold: two children of the root, each as thin as it can be
+    uint64_t fewest = 2 * BTree::MIN_KEYS;
+    while (fewest <= size)
+    {
+        height++;
+        fewest *= BTree::MIN_KEYS + 1;
+    }
+    return height;
+}
+
+static void checkTree(const BTree& tree, const map<string, size_t>& expected, const string& what)
+{
+    check(tree.size() == expected.size(), what + ": size");
+    check(tree.getHeight() <= maximumHeight(tree.size()), what + ": height " + to_string(tree.getHeight()) + " for " + to_string(tree.size()) + " keys");
+    vector<string> keys = tree.keys();
+    check(keys.size() == expected.size(), what + ": key count");
+    size_t i = 0;
+    for (const auto& [key, value] : expected)
+    {
+        if (i >= keys.size() || keys[i] != key || tree.get(key) != value || !tree.contains(key))
+        {
+            check(false, what + ": contents at " + key);
+            return;
+        }
+        i++;
+    }
+}
+
+static void checkRange(const BTree& tree, const map<string, size_t>& expected, string low, string high, const string& what)
+{
+    vector<size_t> values;
+    if (low <= high)
+    {
+        for (auto it = expected.lower_bound(low); it != expected.end() && it->first <= high; ++it)
+        {
+            values.push_back(it->second);
+        }
+    }
+    check(tree.findRange(low, high) == values, what + ": findRange from " + low + " to " + high);
+}
+
+static void testRandomChanges(uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    string name = "seed " + to_string(seed);
+    BTree tree;
+    map<string, size_t> expected;
+    size_t keySpace = 100 + rng() % 3000;
+    for (size_t step = 0; step < 6000; step++)
+    {
+        string key = makeTestKey(rng, keySpace);
+        switch (rng() % 8)
+        {
+            case 0:
+            case 1:
+            case 2:
+                check(tree.insert(key, step) == expected.emplace(key, step).second, name + ": insert " + key);
+                break;
+            case 3:
+            case 4:
+                check(tree.remove(key) == (expected.erase(key) == 1), name + ": remove " + key);
+                break;
+            case 5:
+                tree[key] = step;
+                expected[key] = step;
+                break;
+            case 6:
+                check(tree.get(key) == (expected.count(key) == 1 ? optional<size_t>(expected[key]) : nullopt), name + ": get " + key);
+                break;
+            default:
+                checkRange(tree, expected, key, makeTestKey(rng, keySpace), name);
+                break;
+        }
+        if (step % 500 == 0)
+        {
+            checkTree(tree, expected, name + ", step " + to_string(step));
+        }
+    }
+    checkTree(tree, expected, name);
+
+    //removes everything, so nodes are merged and refilled all the way back to an empty tree
+    BTree copy(tree);
+    BTree assigned;
+    assigned.insert("other", 1);
+    assigned = tree;
+    map<string, size_t> copyExpected = expected;
+    while (!expected.empty())
+    {
+        auto it = expected.begin();
+        advance(it, rng() % expected.size());
+        check(tree.remove(it->first), name + ": remove while emptying " + it->first);
+        expected.erase(it);
+        if (expected.size() % 256 == 0)
+        {
+            checkTree(tree, expected, name + ", emptying at " + to_string(expected.size()));
+        }
+    }
+    checkTree(tree, expected, name + ", emptied");
+    checkTree(copy, copyExpected, name + ", copy");
+    checkTree(assigned, copyExpected, name + ", assigned copy");
+}
+
+//ascending and descending runs split and merge nodes at their ends
+static void testSequential()
+{
+    BTree tree;
+    map<string, size_t> expected;
+    for (size_t i = 0; i < 20000; i++)
+    {
+        tree.insert(makeKey(i), i);
+        expected.emplace(makeKey(i), i);
+    }
+    checkTree(tree, expected, "ascending inserts");
+    for (size_t i = 20000; i-- > 0;)
+    {
+        if (i % 3 != 0)
+        {
+            tree.remove(makeKey(i));
+            expected.erase(makeKey(i));
+        }
+    }
+    checkTree(tree, expected, "descending removes");
+    checkRange(tree, expected, makeKey(100), makeKey(5000), "after sequential changes");
+    checkRange(tree, expected, "", makeKey(20000), "after sequential changes");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t seeds = argc > 1 ? stoul(argv[1]) : 8;
+    testSequential();
+    for (uint64_t seed = 0; seed < seeds; seed++)
+    {
+        testRandomChanges(seed);
+    }
+    return testResult();
+}
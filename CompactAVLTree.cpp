@@ -0,0 +1,490 @@
+#include "CompactAVLTree.h"
+
+#include <algorithm>
+#include <cstring>
+
+//default constructor. The first insert adds the first chunk
+CompactAVLTree::CompactAVLTree()
+{
+    nodeCount = 0;
+    freeHead = NIL;
+    root = NIL;
+    treeSize = 0;
+    deadKeyWords = 0;
+}
+
+//copy constructor that copies the chunks and the arena as they are, so indices and offsets stay valid
+CompactAVLTree::CompactAVLTree(const CompactAVLTree& other)
+{
+    nodeCount = 0;
+    freeHead = NIL;
+    root = NIL;
+    treeSize = 0;
+    deadKeyWords = 0;
+    *this = other;
+}
+
+//Inserts a new key-value pair. A key that is already in the tree keeps its value
+bool CompactAVLTree::insert(const std::string& key, size_t value)
+{
+    bool inserted;
+    findOrInsert(key, value, inserted);
+    return inserted;
+}
+
+//walks down recording the slots on the path. A node with two children takes the key and value of its
+//successor, whose node is unlinked instead, so only a node with at most one child is ever taken out
+bool CompactAVLTree::remove(std::string_view key)
+{
+    uint32_t* path[MAX_HEIGHT];
+    size_t depth = 0;
+    uint64_t prefix = keyPrefix(key);
+
+    uint32_t* slot = &root;
+    while (*slot != NIL)
+    {
+        Node& current = node(*slot);
+        int comparison = compare(key, prefix, current);
+        if (comparison == 0)
+        {
+            break;
+        }
+        path[depth++] = slot;
+        slot = comparison < 0 ? &current.left : &current.right;
+    }
+    if (*slot == NIL)
+    {
+        return false;
+    }
+
+    uint32_t removed = *slot;
+    Node& target = node(removed);
+    releaseKey(target);
+    if (target.left != NIL && target.right != NIL)
+    {
+        path[depth++] = slot;
+        uint32_t* successorSlot = &target.right;
+        while (node(*successorSlot).left != NIL)
+        {
+            path[depth++] = successorSlot;
+            successorSlot = &node(*successorSlot).left;
+        }
+        uint32_t successor = *successorSlot;
+        Node& moved = node(successor);
+        target.prefix = moved.prefix;
+        target.keyOffset = moved.keyOffset;
+        target.inlineLength = moved.inlineLength;
+        target.value = moved.value;
+        *successorSlot = moved.right;
+        freeNode(successor);
+    }else
+    {
+        *slot = target.left != NIL ? target.left : target.right;
+        freeNode(removed);
+    }
+
+    //every node on the path may have lost height, so each one is balanced on the way back up
+    while (depth > 0)
+    {
+        depth--;
+        balance(*path[depth]);
+    }
+    treeSize--;
+
+    if (deadKeyWords >= MIN_COMPACT_WORDS && deadKeyWords * 2 > keyArena.size())
+    {
+        compactKeyArena();
+    }
+    return true;
+}
+
+bool CompactAVLTree::contains(std::string_view key) const
+{
+    return findNode(key) != NIL;
+}
+
+optional<size_t> CompactAVLTree::get(std::string_view key) const
+{
+    uint32_t index = findNode(key);
+    if (index == NIL)
+    {
+        return nullopt;
+    }
+    return node(index).value;
+}
+
+size_t& CompactAVLTree::operator[](std::string_view key)
+{
+    bool inserted;
+    return node(findOrInsert(key, ValueType(), inserted)).value;
+}
+
+//walks down to the first key not below lowKey, keeping the nodes still to visit on a stack, then walks in order
+//until a key is past highKey
+vector<size_t> CompactAVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    vector<size_t> result;
+    uint32_t stack[MAX_HEIGHT];
+    size_t depth = 0;
+    uint64_t lowPrefix = keyPrefix(lowKey);
+    uint64_t highPrefix = keyPrefix(highKey);
+
+    uint32_t current = root;
+    while (current != NIL)
+    {
+        const Node& candidate = node(current);
+        if (compare(lowKey, lowPrefix, candidate) <= 0)
+        {
+            stack[depth++] = current;
+            current = candidate.left;
+        }else
+        {
+            current = candidate.right;
+        }
+    }
+
+    while (depth > 0)
+    {
+        const Node& next = node(stack[--depth]);
+        if (compare(highKey, highPrefix, next) < 0)
+        {
+            break;
+        }
+        result.push_back(next.value);
+        for (uint32_t child = next.right; child != NIL; child = node(child).left)
+        {
+            stack[depth++] = child;
+        }
+    }
+    return result;
+}
+
+//Returns all keys in the tree in order, rebuilt from their prefixes and tails
+std::vector<std::string> CompactAVLTree::keys() const
+{
+    std::vector<std::string> result;
+    result.reserve(treeSize);
+    uint32_t stack[MAX_HEIGHT];
+    size_t depth = 0;
+    for (uint32_t child = root; child != NIL; child = node(child).left)
+    {
+        stack[depth++] = child;
+    }
+    while (depth > 0)
+    {
+        const Node& next = node(stack[--depth]);
+        result.push_back(fullKey(next));
+        for (uint32_t child = next.right; child != NIL; child = node(child).left)
+        {
+            stack[depth++] = child;
+        }
+    }
+    return result;
+}
+
+size_t CompactAVLTree::size() const
+{
+    return treeSize;
+}
+
+size_t CompactAVLTree::getHeight() const
+{
+    return root != NIL ? node(root).height : 0;
+}
+
+//= operator override that copies the other tree's chunks and arena
+void CompactAVLTree::operator=(const CompactAVLTree& other)
+{
+    //checks for self-assignment
+    if (this == &other)
+    {
+        return;
+    }
+    chunks.clear();
+    chunks.reserve(other.chunks.size());
+    for (size_t i = 0; i < other.chunks.size(); i++)
+    {
+        chunks.push_back(std::make_unique_for_overwrite<Node[]>(CHUNK_NODES));
+        //only the last chunk is partly used
+        size_t used = std::min(CHUNK_NODES, other.nodeCount - i * CHUNK_NODES);
+        memcpy(chunks.back().get(), other.chunks[i].get(), used * sizeof(Node));
+    }
+    nodeCount = other.nodeCount;
+    freeHead = other.freeHead;
+    root = other.root;
+    treeSize = other.treeSize;
+    keyArena = other.keyArena;
+    deadKeyWords = other.deadKeyWords;
+}
+
+CompactAVLTree::Node& CompactAVLTree::node(uint32_t index)
+{
+    return chunks[index / CHUNK_NODES][index % CHUNK_NODES];
+}
+
+const CompactAVLTree::Node& CompactAVLTree::node(uint32_t index) const
+{
+    return chunks[index / CHUNK_NODES][index % CHUNK_NODES];
+}
+
+//a new chunk leaves every node already handed out where it is, so indices and references stay valid
+uint32_t CompactAVLTree::allocateNode()
+{
+    if (freeHead != NIL)
+    {
+        uint32_t index = freeHead;
+        freeHead = node(index).left;
+        return index;
+    }
+    if (nodeCount % CHUNK_NODES == 0)
+    {
+        chunks.push_back(std::make_unique_for_overwrite<Node[]>(CHUNK_NODES));
+    }
+    return nodeCount++;
+}
+
+void CompactAVLTree::freeNode(uint32_t index)
+{
+    node(index).left = freeHead;
+    freeHead = index;
+}
+
+uint64_t CompactAVLTree::keyPrefix(std::string_view key)
+{
+    unsigned char bytes[PREFIX_BYTES] = {};
+    memcpy(bytes, key.data(), std::min(key.size(), PREFIX_BYTES));
+    uint64_t prefix = 0;
+    for (unsigned char byte : bytes)
+    {
+        prefix = prefix << 8 | byte;
+    }
+    return prefix;
+}
+
+//the arena entry is the key's full length in one word, then its bytes after the prefix, padded to a whole word
+void CompactAVLTree::storeKey(Node& target, std::string_view key)
+{
+    target.prefix = keyPrefix(key);
+    if (key.size() <= PREFIX_BYTES)
+    {
+        target.inlineLength = static_cast<uint8_t>(key.size());
+        target.keyOffset = 0;
+        return;
+    }
+    target.inlineLength = LONG_KEY;
+    target.keyOffset = static_cast<uint32_t>(keyArena.size());
+    keyArena.resize(keyArena.size() + arenaWords(key.size()));
+    keyArena[target.keyOffset] = key.size();
+    memcpy(&keyArena[target.keyOffset + 1], key.data() + PREFIX_BYTES, key.size() - PREFIX_BYTES);
+}
+
+void CompactAVLTree::releaseKey(const Node& target)
+{
+    if (target.inlineLength == LONG_KEY)
+    {
+        deadKeyWords += arenaWords(keyArena[target.keyOffset]);
+    }
+}
+
+size_t CompactAVLTree::keyLength(const Node& target) const
+{
+    return target.inlineLength != LONG_KEY ? target.inlineLength : keyArena[target.keyOffset];
+}
+
+std::string_view CompactAVLTree::keyTail(const Node& target) const
+{
+    if (target.inlineLength != LONG_KEY)
+    {
+        return std::string_view();
+    }
+    return std::string_view(reinterpret_cast<const char*>(&keyArena[target.keyOffset + 1]), keyArena[target.keyOffset] - PREFIX_BYTES);
+}
+
+std::string CompactAVLTree::fullKey(const Node& target) const
+{
+    std::string key(std::min(keyLength(target), PREFIX_BYTES), '\0');
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        key[i] = static_cast<char>(target.prefix >> (8 * (PREFIX_BYTES - 1 - i)));
+    }
+    key.append(keyTail(target));
+    return key;
+}
+
+size_t CompactAVLTree::arenaWords(size_t keyLength)
+{
+    return 1 + (keyLength - PREFIX_BYTES + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+}
+
+//equal prefixes mean the first PREFIX_BYTES bytes match, where a key shorter than that is padded with zero bytes.
+//If either key is that short, the padding matched bytes of the other, so the shorter key is a prefix of the longer
+//one and the lengths decide. Otherwise the tails do
+int CompactAVLTree::compare(std::string_view key, uint64_t prefix, const Node& target) const
+{
+    if (prefix != target.prefix)
+    {
+        return prefix < target.prefix ? -1 : 1;
+    }
+    size_t length = keyLength(target);
+    if (key.size() < PREFIX_BYTES || length < PREFIX_BYTES)
+    {
+        return key.size() < length ? -1 : (key.size() > length ? 1 : 0);
+    }
+    return key.substr(PREFIX_BYTES).compare(keyTail(target));
+}
+
+uint32_t CompactAVLTree::findNode(std::string_view key) const
+{
+    uint64_t prefix = keyPrefix(key);
+    uint32_t current = root;
+    while (current != NIL)
+    {
+        const Node& candidate = node(current);
+        int comparison = compare(key, prefix, candidate);
+        if (comparison == 0)
+        {
+            return current;
+        }
+        current = comparison < 0 ? candidate.left : candidate.right;
+    }
+    return NIL;
+}
+
+//the slots on the path point into nodes, which a new chunk does not move, so they stay valid across allocateNode
+uint32_t CompactAVLTree::findOrInsert(std::string_view key, ValueType value, bool& inserted)
+{
+    uint32_t* path[MAX_HEIGHT];
+    size_t depth = 0;
+    uint64_t prefix = keyPrefix(key);
+
+    uint32_t* slot = &root;
+    while (*slot != NIL)
+    {
+        Node& current = node(*slot);
+        int comparison = compare(key, prefix, current);
+        if (comparison == 0)
+        {
+            inserted = false;
+            return *slot;
+        }
+        path[depth++] = slot;
+        slot = comparison < 0 ? &current.left : &current.right;
+    }
+
+    uint32_t index = allocateNode();
+    Node& created = node(index);
+    storeKey(created, key);
+    created.value = value;
+    created.left = NIL;
+    created.right = NIL;
+    created.height = 0;
+    *slot = index;
+
+    //once a subtree keeps its old height, nothing above it changes
+    while (depth > 0)
+    {
+        depth--;
+        uint32_t& ancestor = *path[depth];
+        int oldHeight = node(ancestor).height;
+        balance(ancestor);
+        if (node(ancestor).height == oldHeight)
+        {
+            break;
+        }
+    }
+    treeSize++;
+    inserted = true;
+    return index;
+}
+
+int CompactAVLTree::height(uint32_t index) const
+{
+    return index != NIL ? node(index).height : -1;
+}
+
+void CompactAVLTree::updateHeight(Node& target)
+{
+    target.height = static_cast<int8_t>(1 + std::max(height(target.left), height(target.right)));
+}
+
+void CompactAVLTree::rotateLeft(uint32_t& slot)
+{
+    uint32_t top = slot;
+    Node& oldTop = node(top);
+    uint32_t newTop = oldTop.right;
+    Node& rising = node(newTop);
+    oldTop.right = rising.left;
+    rising.left = top;
+    updateHeight(oldTop);
+    updateHeight(rising);
+    slot = newTop;
+}
+
+void CompactAVLTree::rotateRight(uint32_t& slot)
+{
+    uint32_t top = slot;
+    Node& oldTop = node(top);
+    uint32_t newTop = oldTop.left;
+    Node& rising = node(newTop);
+    oldTop.left = rising.right;
+    rising.right = top;
+    updateHeight(oldTop);
+    updateHeight(rising);
+    slot = newTop;
+}
+
+//a single or double rotation when the heights of the subtrees differ by 2, otherwise just the new height
+void CompactAVLTree::balance(uint32_t& slot)
+{
+    Node& top = node(slot);
+    int balanceFactor = height(top.left) - height(top.right);
+    if (balanceFactor > 1)
+    {
+        const Node& left = node(top.left);
+        if (height(left.left) < height(left.right))
+        {
+            rotateLeft(top.left);
+        }
+        rotateRight(slot);
+    }else if (balanceFactor < -1)
+    {
+        const Node& right = node(top.right);
+        if (height(right.right) < height(right.left))
+        {
+            rotateRight(top.right);
+        }
+        rotateLeft(slot);
+    }else
+    {
+        updateHeight(top);
+    }
+}
+
+//in key order, so the tails a range walk compares are next to each other
+void CompactAVLTree::compactKeyArena()
+{
+    std::vector<uint64_t> compacted;
+    compacted.reserve(keyArena.size() - deadKeyWords);
+    uint32_t stack[MAX_HEIGHT];
+    size_t depth = 0;
+    for (uint32_t child = root; child != NIL; child = node(child).left)
+    {
+        stack[depth++] = child;
+    }
+    while (depth > 0)
+    {
+        Node& next = node(stack[--depth]);
+        if (next.inlineLength == LONG_KEY)
+        {
+            const uint64_t* entry = &keyArena[next.keyOffset];
+            next.keyOffset = static_cast<uint32_t>(compacted.size());
+            compacted.insert(compacted.end(), entry, entry + arenaWords(entry[0]));
+        }
+        for (uint32_t child = next.right; child != NIL; child = node(child).left)
+        {
+            stack[depth++] = child;
+        }
+    }
+    keyArena.swap(compacted);
+    deadKeyWords = 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * CompactAVLTree.h
+ */
+
+#ifndef COMPACTAVLTREE_H
+#define COMPACTAVLTREE_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ *AVL tree with the same interface as BTree, stored in arrays instead of separately allocated nodes.
+ *A node is 32 bytes, two to a cache line: 32-bit indices of its children, an int8_t height, the value, and the
+ *first 8 bytes of its key as a big-endian integer, so most steps of a search compare two integers and touch no
+ *other memory. Keys of up to 8 bytes live in the node; the rest of a longer key is kept in a key arena, and is
+ *only read when the first 8 bytes of the two keys are equal.
+ *Nodes sit in chunks of CHUNK_NODES that never move, so a value reference from operator[] survives inserts.
+ *A tree holds at most 2^32 - 1 keys and 32 GiB of key bytes past the first 8 of each key.
+ *Unlike AVLTree, copies are deep and there is no node pool, snapshot or set operation
+ */
+class CompactAVLTree {
+public:
+    using KeyType = std::string;
+    using ValueType = size_t;
+
+    /**
+     *default constructor
+     */
+    CompactAVLTree();
+
+    /**
+     *copy constructor. Copies the node chunks and the key arena, in O(n)
+     */
+    CompactAVLTree(const CompactAVLTree& other);
+
+    /**
+    *Inserts a new key-value pair into the tree. Returns false, and keeps the old value, if the key is already in the tree
+    */
+    bool insert(const std::string& key, size_t value);
+
+    /**
+    *Removes the key if it is in the tree. Rebalances the nodes on the path to it
+    */
+    bool remove(std::string_view key);
+
+    /**
+    *Returns true if the key is in the tree
+    */
+    bool contains(std::string_view key) const;
+
+    /**
+    *Returns the value of the key, or nothing if the key is not in the tree
+    */
+    optional<size_t> get(std::string_view key) const;
+
+    /**
+    *Returns a reference to the key's value, inserting the key with a value of 0 first if it is missing.
+    *The reference stays valid through inserts, since nodes never move, until the next remove or assignment
+    */
+    size_t& operator[](std::string_view key);
+
+    /**
+    *Returns the values of all keys between the two keys (inclusive), in key order
+    */
+    vector<size_t> findRange(std::string_view lowKey, std::string_view highKey) const;
+
+    /**
+    *Returns all keys in the tree, in order
+    */
+    std::vector<std::string> keys() const;
+
+    /**
+    *returns the number of key value pairs in the tree
+    */
+    size_t size() const;
+
+    /**
+    *Returns the height of the tree: 0 for an empty tree and for a single node
+    */
+    size_t getHeight() const;
+
+    /**
+    *= operator overload. Replaces the contents with a copy of the other tree
+    */
+    void operator=(const CompactAVLTree& other);
+
+    //nodes per chunk. A chunk of 32-byte nodes is 128 KiB
+    static constexpr size_t CHUNK_NODES = 4096;
+
+private:
+    //index that stands for no node
+    static constexpr uint32_t NIL = UINT32_MAX;
+    //key bytes kept in the node
+    static constexpr size_t PREFIX_BYTES = sizeof(uint64_t);
+    //inlineLength of a node whose key is longer than PREFIX_BYTES
+    static constexpr uint8_t LONG_KEY = UINT8_MAX;
+    //a tree of 2^32 nodes is at most 1.44 * 32 levels high
+    static constexpr size_t MAX_HEIGHT = 64;
+    //the key arena is not compacted while it has fewer dead words than this
+    static constexpr size_t MIN_COMPACT_WORDS = 4096;
+
+    /**
+     *A key of up to PREFIX_BYTES bytes is prefix and inlineLength alone. A longer key has inlineLength LONG_KEY,
+     *and keyOffset is the word in the key arena where its length is, followed by its bytes after the first PREFIX_BYTES
+     */
+    struct Node {
+        //first PREFIX_BYTES bytes of the key as a big-endian integer, padded with zero bytes
+        uint64_t prefix;
+        ValueType value;
+        //child indices, NIL for none. A free node links to the next free one through left
+        uint32_t left;
+        uint32_t right;
+        uint32_t keyOffset;
+        uint8_t inlineLength;
+        //0 for a leaf
+        int8_t height;
+    };
+    static_assert(sizeof(Node) == 32, "two nodes to a cache line");
+
+    std::vector<std::unique_ptr<Node[]>> chunks;
+    //nodes handed out so far, free ones included
+    uint32_t nodeCount;
+    //first node of the free list
+    uint32_t freeHead;
+    uint32_t root;
+    size_t treeSize;
+    //lengths and tails of the long keys, in 8-byte words so a 32-bit offset reaches 32 GiB
+    std::vector<uint64_t> keyArena;
+    //words in the arena that belong to removed keys
+    size_t deadKeyWords;
+
+    Node& node(uint32_t index);
+    const Node& node(uint32_t index) const;
+
+    /**
+     *takes a node from the free list, or from the end of the last chunk, adding a chunk when it is full
+     */
+    uint32_t allocateNode();
+    void freeNode(uint32_t index);
+
+    /**
+     *first PREFIX_BYTES bytes of a key as a big-endian integer, padded with zero bytes. Two keys whose
+     *prefixes differ compare the same way as their prefixes
+     */
+    static uint64_t keyPrefix(std::string_view key);
+
+    /**
+     *helpers for the key of a node. storeKey sets prefix, inlineLength and keyOffset, appending a long key's
+     *tail to the arena, and releaseKey counts that tail as dead
+     */
+    void storeKey(Node& target, std::string_view key);
+    void releaseKey(const Node& target);
+    size_t keyLength(const Node& target) const;
+    //bytes after the first PREFIX_BYTES, empty for a key kept in the node
+    std::string_view keyTail(const Node& target) const;
+    std::string fullKey(const Node& target) const;
+    //words an arena entry for a key of the given length takes
+    static size_t arenaWords(size_t keyLength);
+
+    /**
+     *Three-way comparison of key, whose prefix the caller has computed once per search, with a node's key
+     */
+    int compare(std::string_view key, uint64_t prefix, const Node& target) const;
+
+    /**
+     *Index of the node with the given key, or NIL
+     */
+    uint32_t findNode(std::string_view key) const;
+
+    /**
+     *helper for insert and operator[]. Returns the index of the node with the given key,
+     *inserting one with the given value if there is none
+     */
+    uint32_t findOrInsert(std::string_view key, ValueType value, bool& inserted);
+
+    /**
+     *AVL helpers. Each takes the slot, a parent's child index or root, that holds the subtree, and leaves the
+     *new top of the subtree in it
+     */
+    int height(uint32_t index) const;
+    void updateHeight(Node& target);
+    void rotateLeft(uint32_t& slot);
+    void rotateRight(uint32_t& slot);
+    void balance(uint32_t& slot);
+
+    /**
+     *Copies the tails of the live long keys into a new arena in key order, once removed keys take up half of it
+     */
+    void compactKeyArena();
+};
+
+#endif //COMPACTAVLTREE_H
@@ -0,0 +1,212 @@
+/*
+Test for CompactAVLTree.
+Makes random changes to a CompactAVLTree and a std::map side by side and checks the tree against the map: every
+key and value through get, contains and keys, findRange over random ranges, and the height against the most
+levels an AVL tree of that size can have. Keys are often prefixes of each other, differ only past the 8 bytes a
+node keeps of each key, or hold zero bytes like the ones a short key is padded with, so comparisons have to fall
+back to lengths and key tails. Also checks that a reference from operator[] survives inserts that add chunks,
+that the key arena keeps every key through the compactions removes set off, and that copies and assignments
+do not change when the original does.
+
+usage: CompactAVLTreeTest [seeds]
+ */
+#include "CompactAVLTree.h"
+#include "TestSupport.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace TestSupport;
+
+//keys from a few families: short ones, ones with a long shared start, ones that are prefixes of each other, and
+//ones with zero bytes
+static string makeTestKey(mt19937_64& rng, size_t keySpace)
+{
+    size_t i = rng() % keySpace;
+    switch (rng() % 5)
+    {
+        case 0:
+            return makeKey(i);
+        case 1:
+            return "a/long/shared/start/of/the/key/" + makeKey(i);
+        case 2:
+            //differs from its neighbours only in the last byte, well past the first 8
+            return "a/long/shared/start/" + string(i % 16, 'x') + char('a' + i % 26);
+        case 3:
+            return string(1 + i % 20, 'k');
+        default:
+            //up to 12 zero bytes and a last byte, so the first 8 bytes of keys of different lengths are often equal
+            return string(i % 13, '\0') + char(i % 3);
+    }
+}
+
+//the most levels below the root for an AVL tree of size keys: the smallest tree of height h has a root, one
+//subtree of height h - 1 and one of height h - 2, each as small as it can be
+static size_t maximumHeight(size_t size)
+{
+    size_t height = 0;
+    uint64_t smaller = 1;
+    uint64_t fewest = 2;
+    while (fewest <= size)
+    {
+        height++;
+        uint64_t next = fewest + smaller + 1;
+        smaller = fewest;
+        fewest = next;
+    }
+    return height;
+}
+
+static void checkTree(const CompactAVLTree& tree, const map<string, size_t>& expected, const string& what)
+{
+    check(tree.size() == expected.size(), what + ": size");
+    check(tree.getHeight() <= maximumHeight(tree.size()), what + ": height " + to_string(tree.getHeight()) + " for " + to_string(tree.size()) + " keys");
+    vector<string> keys = tree.keys();
+    check(keys.size() == expected.size(), what + ": key count");
+    size_t i = 0;
+    for (const auto& [key, value] : expected)
+    {
+        if (i >= keys.size() || keys[i] != key || tree.get(key) != value || !tree.contains(key))
+        {
+            check(false, what + ": contents at " + key);
+            return;
+        }
+        i++;
+    }
+}
+
+static void checkRange(const CompactAVLTree& tree, const map<string, size_t>& expected, string low, string high, const string& what)
+{
+    vector<size_t> values;
+    if (low <= high)
+    {
+        for (auto it = expected.lower_bound(low); it != expected.end() && it->first <= high; ++it)
+        {
+            values.push_back(it->second);
+        }
+    }
+    check(tree.findRange(low, high) == values, what + ": findRange from " + low + " to " + high);
+}
+
+static void testRandomChanges(uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    string name = "seed " + to_string(seed);
+    CompactAVLTree tree;
+    map<string, size_t> expected;
+    size_t keySpace = 100 + rng() % 3000;
+    for (size_t step = 0; step < 6000; step++)
+    {
+        string key = makeTestKey(rng, keySpace);
+        switch (rng() % 8)
+        {
+            case 0:
+            case 1:
+            case 2:
+                check(tree.insert(key, step) == expected.emplace(key, step).second, name + ": insert " + key);
+                break;
+            case 3:
+            case 4:
+                check(tree.remove(key) == (expected.erase(key) == 1), name + ": remove " + key);
+                break;
+            case 5:
+                tree[key] = step;
+                expected[key] = step;
+                break;
+            case 6:
+                check(tree.get(key) == (expected.count(key) == 1 ? optional<size_t>(expected[key]) : nullopt), name + ": get " + key);
+                break;
+            default:
+                checkRange(tree, expected, key, makeTestKey(rng, keySpace), name);
+                break;
+        }
+        if (step % 500 == 0)
+        {
+            checkTree(tree, expected, name + ", step " + to_string(step));
+        }
+    }
+    checkTree(tree, expected, name);
+
+    //removes everything, so freed nodes and dead key words pile up all the way back to an empty tree
+    CompactAVLTree copy(tree);
+    CompactAVLTree assigned;
+    assigned.insert("other", 1);
+    assigned = tree;
+    map<string, size_t> copyExpected = expected;
+    while (!expected.empty())
+    {
+        auto it = expected.begin();
+        advance(it, rng() % expected.size());
+        check(tree.remove(it->first), name + ": remove while emptying " + it->first);
+        expected.erase(it);
+        if (expected.size() % 256 == 0)
+        {
+            checkTree(tree, expected, name + ", emptying at " + to_string(expected.size()));
+        }
+    }
+    checkTree(tree, expected, name + ", emptied");
+    checkTree(copy, copyExpected, name + ", copy");
+    checkTree(assigned, copyExpected, name + ", assigned copy");
+}
+
+//ascending and descending runs rotate at the ends of the tree. The long keys removed leave enough dead words to
+//compact the key arena several times, and the nodes they free are reused by the inserts after them
+static void testSequential()
+{
+    CompactAVLTree tree;
+    map<string, size_t> expected;
+    for (size_t i = 0; i < 20000; i++)
+    {
+        string key = "a/long/shared/start/of/the/key/" + makeKey(i);
+        tree.insert(key, i);
+        expected.emplace(key, i);
+    }
+    checkTree(tree, expected, "ascending inserts");
+    for (size_t i = 20000; i-- > 0;)
+    {
+        if (i % 3 != 0)
+        {
+            string key = "a/long/shared/start/of/the/key/" + makeKey(i);
+            tree.remove(key);
+            expected.erase(key);
+        }
+    }
+    checkTree(tree, expected, "descending removes");
+    for (size_t i = 0; i < 10000; i++)
+    {
+        tree.insert(makeKey(i), i);
+        expected.emplace(makeKey(i), i);
+    }
+    checkTree(tree, expected, "inserts into freed nodes");
+    checkRange(tree, expected, makeKey(100), makeKey(5000), "after sequential changes");
+    checkRange(tree, expected, "", "b", "after sequential changes");
+}
+
+//nodes never move, so a reference from operator[] outlives inserts that add many chunks
+static void testReferences()
+{
+    CompactAVLTree tree;
+    size_t& value = tree["first"];
+    value = 1;
+    for (size_t i = 0; i < 5 * CompactAVLTree::CHUNK_NODES; i++)
+    {
+        tree.insert(makeKey(i), i);
+    }
+    value = 2;
+    check(tree.get("first") == 2, "a reference from operator[] survives inserts that add chunks");
+    check(&tree["first"] == &value, "operator[] gives the same node after inserts");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t seeds = argc > 1 ? stoul(argv[1]) : 8;
+    testSequential();
+    testReferences();
+    for (uint64_t seed = 0; seed < seeds; seed++)
+    {
+        testRandomChanges(seed);
+    }
+    return testResult();
+}
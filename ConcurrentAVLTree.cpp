@@ -0,0 +1,127 @@
+#include "ConcurrentAVLTree.h"
+
+//Writers take the lock exclusively
+
+bool ConcurrentAVLTree::insert(const KeyType& key, ValueType value)
+{
+    std::unique_lock lock(mutex);
+    return tree.insert(key, value);
+}
+
+bool ConcurrentAVLTree::remove(std::string_view key)
+{
+    std::unique_lock lock(mutex);
+    return tree.remove(key);
+}
+
+size_t ConcurrentAVLTree::eraseRange(std::string_view lowKey, std::string_view highKey)
+{
+    std::unique_lock lock(mutex);
+    return tree.eraseRange(lowKey, highKey);
+}
+
+bool ConcurrentAVLTree::assign(std::string_view key, ValueType value)
+{
+    std::unique_lock lock(mutex);
+    return tree.assign(key, value);
+}
+
+bool ConcurrentAVLTree::insert_or_assign(const KeyType& key, ValueType value)
+{
+    std::unique_lock lock(mutex);
+    return tree.insert_or_assign(key, value);
+}
+
+bool ConcurrentAVLTree::insert_or_assign(KeyType&& key, ValueType value)
+{
+    std::unique_lock lock(mutex);
+    return tree.insert_or_assign(std::move(key), value);
+}
+
+//Readers share the lock
+
+bool ConcurrentAVLTree::contains(std::string_view key) const
+{
+    std::shared_lock lock(mutex);
+    return tree.contains(key);
+}
+
+std::optional<ConcurrentAVLTree::ValueType> ConcurrentAVLTree::get(std::string_view key) const
+{
+    std::shared_lock lock(mutex);
+    return tree.get(key);
+}
+
+std::vector<ConcurrentAVLTree::ValueType> ConcurrentAVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    std::shared_lock lock(mutex);
+    return tree.findRange(lowKey, highKey);
+}
+
+std::vector<ConcurrentAVLTree::KeyType> ConcurrentAVLTree::keys() const
+{
+    std::shared_lock lock(mutex);
+    return tree.keys();
+}
+
+size_t ConcurrentAVLTree::size() const
+{
+    std::shared_lock lock(mutex);
+    return tree.size();
+}
+
+size_t ConcurrentAVLTree::getHeight() const
+{
+    std::shared_lock lock(mutex);
+    return tree.getHeight();
+}
+
+//Background rebalancing
+
+ConcurrentAVLTree::~ConcurrentAVLTree()
+{
+    stopMaintenance();
+}
+
+void ConcurrentAVLTree::startMaintenance(std::chrono::milliseconds interval, size_t budget)
+{
+    stopMaintenance();
+    {
+        std::unique_lock lock(mutex);
+        tree.setRelaxedBalance(true);
+    }
+    stopping = false;
+    maintenance = std::thread(&ConcurrentAVLTree::maintain, this, interval, budget);
+}
+
+void ConcurrentAVLTree::stopMaintenance()
+{
+    if (!maintenance.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard lock(maintenanceMutex);
+        stopping = true;
+    }
+    wakeMaintenance.notify_one();
+    maintenance.join();
+
+    std::unique_lock lock(mutex);
+    tree.setRelaxedBalance(false);
+}
+
+//maintenanceMutex is let go while rebalancing, so stopMaintenance never waits for the tree's lock to set stopping
+void ConcurrentAVLTree::maintain(std::chrono::milliseconds interval, size_t budget)
+{
+    std::unique_lock lock(maintenanceMutex);
+    while (!wakeMaintenance.wait_for(lock, interval, [this] { return stopping; }))
+    {
+        lock.unlock();
+        {
+            std::unique_lock treeLock(mutex);
+            tree.rebalance(budget);
+        }
+        lock.lock();
+    }
+}
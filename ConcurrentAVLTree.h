@@ -0,0 +1,113 @@
+/**
+ * ConcurrentAVLTree.h
+ */
+
+#ifndef CONCURRENTAVLTREE_H
+#define CONCURRENTAVLTREE_H
+#include "AVLTree.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+/**
+ *Thread-safe wrapper around AVLTree using a reader-writer lock.
+ *Any number of get/contains/findRange calls run in parallel, while insert,
+ *remove and assign take the lock exclusively.
+ */
+class ConcurrentAVLTree {
+public:
+    using KeyType = AVLTree::KeyType;
+    using ValueType = AVLTree::ValueType;
+
+    ConcurrentAVLTree() = default;
+
+    ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+
+    /**
+     *Stops the maintenance thread if there is one
+     */
+    ~ConcurrentAVLTree();
+
+    /**
+     *Writers. Each one holds the lock exclusively for a single tree operation
+     */
+    bool insert(const KeyType& key, ValueType value);
+    bool remove(std::string_view key);
+    size_t eraseRange(std::string_view lowKey, std::string_view highKey);
+
+    /**
+     *AVLTree::assign under the lock. Takes the place of operator[], whose reference would outlive the lock
+     */
+    bool assign(std::string_view key, ValueType value);
+
+    /**
+     *Inserts the key or replaces its value, in one descent under the lock. Returns true if the key was inserted
+     */
+    bool insert_or_assign(const KeyType& key, ValueType value);
+    bool insert_or_assign(KeyType&& key, ValueType value);
+
+    /**
+     *Readers. These share the lock with each other
+     */
+    bool contains(std::string_view key) const;
+    std::optional<ValueType> get(std::string_view key) const;
+    std::vector<ValueType> findRange(std::string_view lowKey, std::string_view highKey) const;
+    std::vector<KeyType> keys() const;
+    size_t size() const;
+    size_t getHeight() const;
+
+    /**
+     *Runs a function on the tree while holding the shared lock, for reads that need more
+     *than one call to stay consistent, such as walking the tree with iterators
+     */
+    template <class Function>
+    auto read(Function function) const
+    {
+        std::shared_lock lock(mutex);
+        return function(static_cast<const AVLTree&>(tree));
+    }
+
+    /**
+     *Runs a function on the tree while holding the lock exclusively.
+     *The function must not turn on the tree's hot-key cache, since that makes the shared readers write to the tree
+     */
+    template <class Function>
+    auto write(Function function)
+    {
+        std::unique_lock lock(mutex);
+        return function(tree);
+    }
+
+    /**
+     *Puts the tree in relaxed balance mode and starts a thread that rebalances it in the background: every interval
+     *it takes the lock exclusively and calls rebalance(budget). Writers then skip most rotations, and each pass holds
+     *readers up for no more than about budget nodes of work. Calling it again restarts the thread with the new settings
+     */
+    void startMaintenance(std::chrono::milliseconds interval, size_t budget);
+
+    /**
+     *Stops the maintenance thread and leaves relaxed mode, which rebalances whatever the thread did not get to
+     */
+    void stopMaintenance();
+
+private:
+    mutable std::shared_mutex mutex;
+    AVLTree tree;
+
+    //background rebalancing. stopping is guarded by maintenanceMutex
+    std::thread maintenance;
+    std::mutex maintenanceMutex;
+    std::condition_variable wakeMaintenance;
+    bool stopping = false;
+
+    /**
+     *Body of the maintenance thread
+     */
+    void maintain(std::chrono::milliseconds interval, size_t budget);
+};
+
+#endif //CONCURRENTAVLTREE_H
@@ -0,0 +1,174 @@
+#include "DurableAVLTree.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+//fsyncs a file or a directory by path
+static bool syncPath(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+//a snapshot that is missing is an empty tree, one that is there has to load. The log is replayed
+//onto the snapshot, which may already hold some of its changes if a crash came in the middle of checkpoint
+bool DurableAVLTree::open(const std::string& directory, Options options)
+{
+    close();
+    tree = AVLTree();
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        return false;
+    }
+    snapshotPath = directory + "/snapshot.avl";
+    if (std::filesystem::exists(snapshotPath, error) && !tree.load(snapshotPath))
+    {
+        return false;
+    }
+    if (error || !log.open(directory + "/log.wal", options, [this](const WriteAheadLog::Record& record) { replay(record); }))
+    {
+        tree = AVLTree();
+        return false;
+    }
+    return true;
+}
+
+void DurableAVLTree::close()
+{
+    log.close();
+}
+
+//Writers log a change before making it, and only make it if the log took the record. Whether anything
+//would change is found out first, since nothing is logged for a change that does nothing
+
+bool DurableAVLTree::insert(const KeyType& key, ValueType value)
+{
+    if (tree.contains(key) || (log.isOpen() && !log.appendInsert(key, value)))
+    {
+        return false;
+    }
+    return tree.insert(key, value);
+}
+
+bool DurableAVLTree::insert_or_assign(const KeyType& key, ValueType value)
+{
+    if (log.isOpen() && !log.appendAssign(key, value))
+    {
+        return false;
+    }
+    return tree.insert_or_assign(key, value);
+}
+
+bool DurableAVLTree::remove(std::string_view key)
+{
+    if (!tree.contains(key) || (log.isOpen() && !log.appendRemove(key)))
+    {
+        return false;
+    }
+    return tree.remove(key);
+}
+
+size_t DurableAVLTree::eraseRange(std::string_view lowKey, std::string_view highKey)
+{
+    if (tree.countRange(lowKey, highKey) == 0 || (log.isOpen() && !log.appendEraseRange(lowKey, highKey)))
+    {
+        return 0;
+    }
+    return tree.eraseRange(lowKey, highKey);
+}
+
+//Readers
+
+bool DurableAVLTree::contains(std::string_view key) const
+{
+    return tree.contains(key);
+}
+
+std::optional<DurableAVLTree::ValueType> DurableAVLTree::get(std::string_view key) const
+{
+    return tree.get(key);
+}
+
+std::vector<DurableAVLTree::ValueType> DurableAVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    return tree.findRange(lowKey, highKey);
+}
+
+std::vector<DurableAVLTree::KeyType> DurableAVLTree::keys() const
+{
+    return tree.keys();
+}
+
+size_t DurableAVLTree::size() const
+{
+    return tree.size();
+}
+
+const AVLTree& DurableAVLTree::contents() const
+{
+    return tree;
+}
+
+bool DurableAVLTree::sync()
+{
+    return log.sync();
+}
+
+bool DurableAVLTree::hasFailed() const
+{
+    return log.hasFailed();
+}
+
+//AVLTree::save renames a finished file into place but does not sync it, so the snapshot is saved under a
+//staging name, synced, and only then renamed over the old one. The log is emptied last. A crash before
+//that replays the whole log onto the new snapshot, which gives the same tree: each record sets its keys
+//to a state that does not depend on what came before, or, for insert, leaves a key that is there alone
+bool DurableAVLTree::checkpoint()
+{
+    if (!log.isOpen())
+    {
+        return false;
+    }
+    std::string stagingPath = snapshotPath + ".new";
+    std::string directory = std::filesystem::path(snapshotPath).parent_path().string();
+    if (!tree.save(stagingPath) || !syncPath(stagingPath))
+    {
+        std::remove(stagingPath.c_str());
+        return false;
+    }
+    if (std::rename(stagingPath.c_str(), snapshotPath.c_str()) != 0 || !syncPath(directory))
+    {
+        return false;
+    }
+    return log.truncate();
+}
+
+void DurableAVLTree::replay(const WriteAheadLog::Record& record)
+{
+    switch (record.type)
+    {
+        case WriteAheadLog::RecordType::Insert:
+            tree.insert(KeyType(record.key), record.value);
+            break;
+        case WriteAheadLog::RecordType::Assign:
+            tree.insert_or_assign(KeyType(record.key), record.value);
+            break;
+        case WriteAheadLog::RecordType::Remove:
+            tree.remove(record.key);
+            break;
+        case WriteAheadLog::RecordType::EraseRange:
+            tree.eraseRange(record.key, record.highKey);
+            break;
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * DurableAVLTree.h
+ */
+
+#ifndef DURABLEAVLTREE_H
+#define DURABLEAVLTREE_H
+#include "AVLTree.h"
+#include "WriteAheadLog.h"
+
+#include <string>
+
+/**
+ *AVLTree that survives a crash. It keeps two files in a directory: a snapshot written by AVLTree::save,
+ *and a WriteAheadLog with every change made since. open loads the snapshot and replays the log onto it,
+ *and checkpoint writes a new snapshot and empties the log, which otherwise keeps growing.
+ *How much a crash can lose is set by the log's SyncPolicy; sync makes everything before it durable.
+ *A change is only made once the log has taken its record, so under SyncPolicy::Always a writer that reports
+ *a change has it on disk. Once the log fails, writers are refused until a checkpoint succeeds.
+ *Like AVLTree it is for one thread at a time. There is no operator[], since a write through its reference
+ *could not be logged; insert_or_assign takes its place
+ */
+class DurableAVLTree {
+public:
+    using KeyType = AVLTree::KeyType;
+    using ValueType = AVLTree::ValueType;
+    using Options = WriteAheadLog::Options;
+    using SyncPolicy = WriteAheadLog::SyncPolicy;
+
+    DurableAVLTree() = default;
+
+    DurableAVLTree(const DurableAVLTree&) = delete;
+    DurableAVLTree& operator=(const DurableAVLTree&) = delete;
+
+    /**
+     *Opens the tree kept in directory, creating the directory if it is missing. Returns false, leaving
+     *the tree empty and closed, if the snapshot or the log is there but cannot be read
+     */
+    bool open(const std::string& directory, Options options = {});
+
+    /**
+     *Writes out the log and closes it. The tree keeps its contents, but changes are no longer logged
+     */
+    void close();
+
+    /**
+     *Writers. Each one appends a record to the log if anything would change, and changes the tree only if
+     *the append succeeded. A refused change leaves the tree as it was and returns false, or 0 for eraseRange,
+     *which for insert_or_assign is also what an assign returns; hasFailed tells them apart
+     */
+    bool insert(const KeyType& key, ValueType value);
+    bool insert_or_assign(const KeyType& key, ValueType value);
+    bool remove(std::string_view key);
+    size_t eraseRange(std::string_view lowKey, std::string_view highKey);
+
+    /**
+     *Readers, straight from the tree
+     */
+    bool contains(std::string_view key) const;
+    std::optional<ValueType> get(std::string_view key) const;
+    std::vector<ValueType> findRange(std::string_view lowKey, std::string_view highKey) const;
+    std::vector<KeyType> keys() const;
+    size_t size() const;
+
+    /**
+     *The tree itself, for reads the calls above do not cover, such as walking it with iterators
+     */
+    const AVLTree& contents() const;
+
+    /**
+     *Writes and syncs every logged change. Returns false if the log failed to write a change since it was
+     *opened or last checkpointed
+     */
+    bool sync();
+
+    /**
+     *Whether the log has failed, so that writers are refused. A successful checkpoint clears it
+     */
+    bool hasFailed() const;
+
+    /**
+     *Saves the tree as the new snapshot and empties the log. Returns false, keeping the old snapshot and
+     *the log, if the snapshot could not be written
+     */
+    bool checkpoint();
+
+private:
+    AVLTree tree;
+    WriteAheadLog log;
+    std::string snapshotPath;
+
+    /**
+     *Applies a record read back from the log to the tree
+     */
+    void replay(const WriteAheadLog::Record& record);
+};
+
+#endif //DURABLEAVLTREE_H
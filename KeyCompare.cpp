@@ -0,0 +1,165 @@
+#include "KeyCompare.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KEYCOMPARE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace KeyCompare {
+
+    //8 bytes per step. In a little-endian word the lowest set bit of the XOR lies in the first byte that differs
+    static size_t firstDifference(uint64_t wordA, uint64_t wordB)
+    {
+        uint64_t difference = wordA ^ wordB;
+        if constexpr (std::endian::native == std::endian::little)
+        {
+            return std::countr_zero(difference) / 8;
+        }else
+        {
+            return std::countl_zero(difference) / 8;
+        }
+    }
+
+    //the last word is read so that it ends at length, overlapping bytes already known to be equal,
+    //which keeps the tail to one step instead of a loop over single bytes
+    static size_t commonPrefixScalar(const char* a, const char* b, size_t length)
+    {
+        if (length < sizeof(uint64_t))
+        {
+            size_t i = 0;
+            while (i < length && a[i] == b[i])
+            {
+                i++;
+            }
+            return i;
+        }
+
+        uint64_t wordA;
+        uint64_t wordB;
+        for (size_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+        {
+            memcpy(&wordA, a + i, sizeof(wordA));
+            memcpy(&wordB, b + i, sizeof(wordB));
+            if (wordA != wordB)
+            {
+                return i + firstDifference(wordA, wordB);
+            }
+        }
+        size_t last = length - sizeof(uint64_t);
+        memcpy(&wordA, a + last, sizeof(wordA));
+        memcpy(&wordB, b + last, sizeof(wordB));
+        return wordA != wordB ? last + firstDifference(wordA, wordB) : length;
+    }
+
+#ifdef KEYCOMPARE_X86
+    //SSE2 is part of x86-64, so this kernel needs no check. Bit j of the movemask is set when byte j is equal,
+    //so the lowest clear bit is the first difference. Like the scalar kernel, the last vector ends at length;
+    //reading past the end of a key instead could cross into an unmapped page
+    static size_t commonPrefixSse2(const char* a, const char* b, size_t length)
+    {
+        if (length < 16)
+        {
+            return commonPrefixScalar(a, b, length);
+        }
+        auto different = [&](size_t i) {
+            __m128i vectorA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vectorB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            return ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(vectorA, vectorB))) & 0xFFFFu;
+        };
+        for (size_t i = 0; i + 16 <= length; i += 16)
+        {
+            if (unsigned mask = different(i))
+            {
+                return i + std::countr_zero(mask);
+            }
+        }
+        unsigned mask = different(length - 16);
+        return mask != 0 ? length - 16 + std::countr_zero(mask) : length;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t commonPrefixAvx2(const char* a, const char* b, size_t length)
+    {
+        if (length < 32)
+        {
+            return commonPrefixSse2(a, b, length);
+        }
+        auto different = [&](size_t i) __attribute__((target("avx2"))) {
+            __m256i vectorA = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vectorB = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            return ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(vectorA, vectorB)));
+        };
+        for (size_t i = 0; i + 32 <= length; i += 32)
+        {
+            if (unsigned mask = different(i))
+            {
+                return i + std::countr_zero(mask);
+            }
+        }
+        unsigned mask = different(length - 32);
+        return mask != 0 ? length - 32 + std::countr_zero(mask) : length;
+    }
+#endif
+
+    using Kernel = size_t (*)(const char*, const char*, size_t);
+
+    static size_t resolveKernel(const char* a, const char* b, size_t length);
+
+    //starts out as resolveKernel, which asks the CPU on the first call and replaces itself with the kernel.
+    //Being constant-initialized, it is ready even for trees used by other files' static constructors
+    static std::atomic<Kernel> kernel{resolveKernel};
+    static std::atomic<const char*> kernelNameInUse{nullptr};
+
+    static size_t resolveKernel(const char* a, const char* b, size_t length)
+    {
+        Kernel selected = commonPrefixScalar;
+        const char* name = "scalar";
+#ifdef KEYCOMPARE_X86
+        __builtin_cpu_init();
+        selected = commonPrefixSse2;
+        name = "sse2";
+        if (__builtin_cpu_supports("avx2"))
+        {
+            selected = commonPrefixAvx2;
+            name = "avx2";
+        }
+#endif
+        kernelNameInUse.store(name, std::memory_order_relaxed);
+        kernel.store(selected, std::memory_order_relaxed);
+        return selected(a, b, length);
+    }
+
+    //every thread that sees resolveKernel picks the same kernel, so the relaxed loads and stores are enough
+    size_t commonPrefixLength(const char* a, const char* b, size_t length)
+    {
+        return kernel.load(std::memory_order_relaxed)(a, b, length);
+    }
+
+    //bytes compare as unsigned char, like std::string::compare
+    int compare(std::string_view a, std::string_view b, size_t& shared)
+    {
+        size_t length = std::min(a.size(), b.size());
+        size_t start = std::min(shared, length);
+        shared = start + commonPrefixLength(a.data() + start, b.data() + start, length - start);
+        if (shared < length)
+        {
+            return static_cast<unsigned char>(a[shared]) < static_cast<unsigned char>(b[shared]) ? -1 : 1;
+        }
+        return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+    }
+
+    const char* kernelName()
+    {
+        if (kernelNameInUse.load(std::memory_order_relaxed) == nullptr)
+        {
+            commonPrefixLength("", "", 0);
+        }
+        return kernelNameInUse.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ * KeyCompare.h
+ *
+ * Kernels that find the first byte in which two keys differ, 32 bytes per step with AVX2 or 16 with SSE2,
+ * and 8-byte words elsewhere. The kernel is chosen the first time one is needed, from what the CPU reports.
+ *
+ * A plain three-way comparison is left to std::string::compare: it calls the C library's memcmp, which is
+ * already vectorized and chosen per CPU, and the extra call here would make it slower. These kernels are for
+ * comparisons that also need to know where the keys differ: BTree uses them for the bytes all keys of a node
+ * share, and AVLTree built with AVLTREE_PREFIX_BOUNDS to skip the prefix a descent knows to be equal.
+ */
+
+#ifndef KEYCOMPARE_H
+#define KEYCOMPARE_H
+#include <cstddef>
+#include <string_view>
+
+namespace KeyCompare {
+
+    /**
+     *Number of leading bytes a and b share. Both must be at least length bytes long
+     */
+    size_t commonPrefixLength(const char* a, const char* b, size_t length);
+
+    /**
+     *Three-way comparison with the same result as a.compare(b), for two keys whose first shared bytes
+     *are known to be equal. Compares from there on and sets shared to the number of leading bytes a and b
+     *have in common, which a following comparison against a related key can start from
+     */
+    int compare(std::string_view a, std::string_view b, size_t& shared);
+
+    /**
+     *Name of the kernel in use: "avx2", "sse2" or "scalar"
+     */
+    const char* kernelName();
+}
+
+#endif //KEYCOMPARE_H
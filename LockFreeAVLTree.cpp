@@ -0,0 +1,200 @@
+#include "LockFreeAVLTree.h"
+
+#include <algorithm>
+#include <cstdint>
+
+//The epoch scheme: a writer publishes a new version, then takes the global epoch as the old version's retiredAt
+//and advances it. A reader stores the epoch it sees in its record before loading the current version, with
+//a fence between, and the writer has a fence between publishing and reading the records. So either the reader
+//loads the new version, or the writer sees the reader's epoch, which is at most retiredAt: a reader that saw a
+//later epoch synchronized with the writer and so loads the new version. A version is freed once every record
+//is idle or shows an epoch after its retiredAt
+
+namespace {
+
+    constexpr uint64_t IDLE = UINT64_MAX;
+
+    //one per thread that has read a LockFreeAVLTree, alone in its cache line. Records are reused by later
+    //threads but never freed, so writers can walk the list without locks
+    struct alignas(64) ReaderRecord {
+        //the global epoch the thread entered its read in, or IDLE
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> inUse{true};
+        //guards entered and not left. Only used by the owning thread
+        size_t depth = 0;
+        ReaderRecord* next = nullptr;
+    };
+
+    std::atomic<uint64_t> globalEpoch{0};
+    std::atomic<ReaderRecord*> readerRecords{nullptr};
+
+    //takes a record a finished thread gave up, or pushes a new one
+    ReaderRecord* acquireRecord()
+    {
+        for (ReaderRecord* record = readerRecords.load(std::memory_order_acquire); record != nullptr; record = record->next)
+        {
+            bool inUse = false;
+            if (!record->inUse.load(std::memory_order_relaxed)
+                && record->inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+            {
+                return record;
+            }
+        }
+        ReaderRecord* record = new ReaderRecord;
+        record->next = readerRecords.load(std::memory_order_relaxed);
+        while (!readerRecords.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return record;
+    }
+
+    //gives the record back when the thread ends. Its epoch is IDLE by then, since guards do not outlive the thread
+    struct ThreadRecord {
+        ReaderRecord* record = acquireRecord();
+
+        ~ThreadRecord()
+        {
+            record->inUse.store(false, std::memory_order_release);
+        }
+    };
+
+    thread_local ThreadRecord threadRecord;
+}
+
+LockFreeAVLTree::Version::Version(const AVLTree& tree) : tree(tree)
+{
+    height = this->tree.getHeight();
+    retiredAt = 0;
+}
+
+LockFreeAVLTree::ReadGuard::ReadGuard()
+{
+    ReaderRecord* record = threadRecord.record;
+    if (record->depth++ == 0)
+    {
+        record->epoch.store(globalEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+LockFreeAVLTree::ReadGuard::~ReadGuard()
+{
+    ReaderRecord* record = threadRecord.record;
+    if (--record->depth == 0)
+    {
+        record->epoch.store(IDLE, std::memory_order_release);
+    }
+}
+
+//the copy shares every node with the current version, so it costs one reference count
+LockFreeAVLTree::PendingVersion::PendingVersion(LockFreeAVLTree& owner) : owner(owner)
+{
+    version = new Version(owner.current.load(std::memory_order_relaxed)->tree);
+}
+
+LockFreeAVLTree::PendingVersion::~PendingVersion()
+{
+    owner.publish(version);
+}
+
+LockFreeAVLTree::LockFreeAVLTree()
+{
+    current.store(new Version(AVLTree()), std::memory_order_relaxed);
+}
+
+LockFreeAVLTree::~LockFreeAVLTree()
+{
+    for (Version* version : retired)
+    {
+        delete version;
+    }
+    delete current.load(std::memory_order_relaxed);
+}
+
+//Writers publish a changed copy through write
+
+bool LockFreeAVLTree::insert(const KeyType& key, ValueType value)
+{
+    return write([&](AVLTree& tree) { return tree.insert(key, value); });
+}
+
+bool LockFreeAVLTree::remove(std::string_view key)
+{
+    return write([&](AVLTree& tree) { return tree.remove(key); });
+}
+
+size_t LockFreeAVLTree::eraseRange(std::string_view lowKey, std::string_view highKey)
+{
+    return write([&](AVLTree& tree) { return tree.eraseRange(lowKey, highKey); });
+}
+
+bool LockFreeAVLTree::assign(std::string_view key, ValueType value)
+{
+    return write([&](AVLTree& tree) { return tree.assign(key, value); });
+}
+
+bool LockFreeAVLTree::insert_or_assign(const KeyType& key, ValueType value)
+{
+    return write([&](AVLTree& tree) { return tree.insert_or_assign(key, value); });
+}
+
+//Readers search whichever version is current when they start
+
+bool LockFreeAVLTree::contains(std::string_view key) const
+{
+    return read([&](const AVLTree& tree) { return tree.contains(key); });
+}
+
+std::optional<LockFreeAVLTree::ValueType> LockFreeAVLTree::get(std::string_view key) const
+{
+    return read([&](const AVLTree& tree) { return tree.get(key); });
+}
+
+std::vector<LockFreeAVLTree::ValueType> LockFreeAVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    return read([&](const AVLTree& tree) { return tree.findRange(lowKey, highKey); });
+}
+
+std::vector<LockFreeAVLTree::KeyType> LockFreeAVLTree::keys() const
+{
+    return read([&](const AVLTree& tree) { return tree.keys(); });
+}
+
+size_t LockFreeAVLTree::size() const
+{
+    return read([&](const AVLTree& tree) { return tree.size(); });
+}
+
+size_t LockFreeAVLTree::getHeight() const
+{
+    ReadGuard guard;
+    return current.load(std::memory_order_acquire)->height;
+}
+
+void LockFreeAVLTree::publish(Version* version)
+{
+    version->height = version->tree.getHeight();
+    Version* previous = current.load(std::memory_order_relaxed);
+    current.store(version, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    previous->retiredAt = globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+    retired.push_back(previous);
+    if (retired.size() >= RECLAIM_BATCH)
+    {
+        reclaim();
+    }
+}
+
+void LockFreeAVLTree::reclaim()
+{
+    uint64_t oldest = IDLE;
+    for (ReaderRecord* record = readerRecords.load(std::memory_order_acquire); record != nullptr; record = record->next)
+    {
+        oldest = std::min(oldest, record->epoch.load(std::memory_order_acquire));
+    }
+    while (!retired.empty() && retired.front()->retiredAt < oldest)
+    {
+        delete retired.front();
+        retired.pop_front();
+    }
+}
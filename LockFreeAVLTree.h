@@ -0,0 +1,140 @@
+/**
+ * LockFreeAVLTree.h
+ */
+
+#ifndef LOCKFREEAVLTREE_H
+#define LOCKFREEAVLTREE_H
+#include "AVLTree.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+/**
+ *Thread-safe AVLTree whose readers take no locks, in the style of RCU.
+ *The tree is published as a version that is never changed again. A reader loads the current version
+ *with one atomic load and searches it, however many writers come and go meanwhile. Writers take turns
+ *under a mutex: each one copies the current version in O(1), changes the copy, which copies only the
+ *nodes on the paths it touches, rotations included, and publishes it with one atomic store.
+ *A replaced version is retired and freed once no reader can still be inside it. Readers announce the
+ *epoch they entered in, each thread in its own cache line, so reads write no memory that another
+ *thread reads or writes in the meantime, apart from the writer's scan of those announcements.
+ *The epochs are shared by every LockFreeAVLTree, so a long read of one tree holds back freeing in all of them
+ */
+class LockFreeAVLTree {
+public:
+    using KeyType = AVLTree::KeyType;
+    using ValueType = AVLTree::ValueType;
+
+    LockFreeAVLTree();
+
+    LockFreeAVLTree(const LockFreeAVLTree&) = delete;
+    LockFreeAVLTree& operator=(const LockFreeAVLTree&) = delete;
+
+    /**
+     *Frees every version. No thread may still be reading the tree
+     */
+    ~LockFreeAVLTree();
+
+    /**
+     *Writers. Each one publishes a new version. See ConcurrentAVLTree for assign and insert_or_assign
+     */
+    bool insert(const KeyType& key, ValueType value);
+    bool remove(std::string_view key);
+    size_t eraseRange(std::string_view lowKey, std::string_view highKey);
+    bool assign(std::string_view key, ValueType value);
+    bool insert_or_assign(const KeyType& key, ValueType value);
+
+    /**
+     *Readers. These take no locks, and each one sees a single version of the tree
+     */
+    bool contains(std::string_view key) const;
+    std::optional<ValueType> get(std::string_view key) const;
+    std::vector<ValueType> findRange(std::string_view lowKey, std::string_view highKey) const;
+    std::vector<KeyType> keys() const;
+    size_t size() const;
+    size_t getHeight() const;
+
+    /**
+     *Runs a function on the current version, for reads that need more than one call to stay consistent,
+     *such as walking the tree with iterators. The version stays valid until the function returns.
+     *The function must not call getHeight on the tree, since writers update the reference counts next to each node's height
+     */
+    template <class Function>
+    auto read(Function function) const
+    {
+        ReadGuard guard;
+        return function(static_cast<const AVLTree&>(current.load(std::memory_order_acquire)->tree));
+    }
+
+    /**
+     *Runs a function on a copy of the current version while holding the writers' mutex, and publishes the copy
+     *afterwards. Several changes made in one call become visible to readers together.
+     *The function must not keep a reference into the tree, such as one returned by operator[], or turn on its hot-key cache
+     */
+    template <class Function>
+    auto write(Function function)
+    {
+        std::lock_guard lock(writeMutex);
+        PendingVersion pending(*this);
+        return function(pending.version->tree);
+    }
+
+private:
+    /**
+     *A published tree. height is kept here because reading it from the root would race with
+     *writers changing the root's reference count, which shares a word with the height
+     */
+    struct Version {
+        AVLTree tree;
+        size_t height;
+        //global epoch when the version was replaced
+        uint64_t retiredAt;
+
+        explicit Version(const AVLTree& tree);
+    };
+
+    /**
+     *Marks the calling thread as reading for as long as it lives. Nested guards keep the outermost one's epoch
+     */
+    class ReadGuard {
+    public:
+        ReadGuard();
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+
+    /**
+     *Copy of the current version that a writer changes, published when it goes out of scope
+     */
+    struct PendingVersion {
+        LockFreeAVLTree& owner;
+        Version* version;
+
+        explicit PendingVersion(LockFreeAVLTree& owner);
+        ~PendingVersion();
+    };
+
+    //retired versions are only freed in batches of this many, so most writes skip the scan of the readers
+    static constexpr size_t RECLAIM_BATCH = 32;
+
+    std::atomic<Version*> current;
+    //guards everything below, and every change to the nodes' reference counts
+    std::mutex writeMutex;
+    //oldest first, so also in order of retiredAt
+    std::deque<Version*> retired;
+
+    /**
+     *Publishes version in place of the current one, which is retired
+     */
+    void publish(Version* version);
+
+    /**
+     *Frees the retired versions that no reader can still be inside
+     */
+    void reclaim();
+};
+
+#endif //LOCKFREEAVLTREE_H
@@ -0,0 +1,162 @@
+#include "MappedAVLTree.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace AVLTreeFormat;
+
+MappedAVLTree::MappedAVLTree()
+{
+    data = nullptr;
+    mappedSize = 0;
+    header = {};
+}
+
+MappedAVLTree::~MappedAVLTree()
+{
+    close();
+}
+
+//maps the whole file read-only, then checks the header, the checksum and every record before serving lookups
+bool MappedAVLTree::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(FileHeader)))
+    {
+        ::close(fd);
+        return false;
+    }
+    size_t fileSize = status.st_size;
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    data = static_cast<const char*>(mapping);
+    mappedSize = fileSize;
+
+    memcpy(&header, data, sizeof(header));
+    if (!headerIsValid(header, fileSize)
+        || checksum(data + sizeof(header), fileSize - sizeof(header)) != header.checksum)
+    {
+        close();
+        return false;
+    }
+
+    //binary search needs every record in bounds and the keys strictly increasing
+    std::string_view previousKey;
+    for (uint64_t i = 0; i < header.count; i++)
+    {
+        std::string_view key;
+        uint64_t value;
+        if (!readRecord(data, header, i, key, value) || (i > 0 && key <= previousKey))
+        {
+            close();
+            return false;
+        }
+        previousKey = key;
+    }
+    return true;
+}
+
+void MappedAVLTree::close()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<char*>(data), mappedSize);
+    }
+    data = nullptr;
+    mappedSize = 0;
+    header = {};
+}
+
+bool MappedAVLTree::isOpen() const
+{
+    return data != nullptr;
+}
+
+bool MappedAVLTree::contains(std::string_view key) const
+{
+    size_t index = lowerBound(key);
+    return index < size() && keyAt(index) == key;
+}
+
+std::optional<MappedAVLTree::ValueType> MappedAVLTree::get(std::string_view key) const
+{
+    size_t index = lowerBound(key);
+    if (index < size() && keyAt(index) == key)
+    {
+        return valueAt(index);
+    }
+    return std::nullopt;
+}
+
+//the records are in key order, so the range is a run of consecutive records starting at the lower bound
+std::vector<MappedAVLTree::ValueType> MappedAVLTree::findRange(std::string_view lowKey, std::string_view highKey) const
+{
+    std::vector<ValueType> result;
+    for (size_t index = lowerBound(lowKey); index < size() && keyAt(index) <= highKey; index++)
+    {
+        result.push_back(valueAt(index));
+    }
+    return result;
+}
+
+std::vector<MappedAVLTree::KeyType> MappedAVLTree::keys() const
+{
+    std::vector<KeyType> result;
+    result.reserve(size());
+    for (size_t index = 0; index < size(); index++)
+    {
+        result.emplace_back(keyAt(index));
+    }
+    return result;
+}
+
+size_t MappedAVLTree::size() const
+{
+    return header.count;
+}
+
+//open() has checked every record, so these skip the bounds checks
+std::string_view MappedAVLTree::keyAt(size_t index) const
+{
+    uint64_t offset = readInteger<uint64_t>(data + header.indexOffset + index * sizeof(uint64_t));
+    uint32_t keyLength = readInteger<uint32_t>(data + offset + sizeof(uint64_t));
+    return std::string_view(data + offset + RECORD_HEADER_SIZE, keyLength);
+}
+
+MappedAVLTree::ValueType MappedAVLTree::valueAt(size_t index) const
+{
+    uint64_t offset = readInteger<uint64_t>(data + header.indexOffset + index * sizeof(uint64_t));
+    return readInteger<uint64_t>(data + offset);
+}
+
+size_t MappedAVLTree::lowerBound(std::string_view key) const
+{
+    size_t low = 0;
+    size_t high = size();
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (keyAt(middle) < key)
+        {
+            low = middle + 1;
+        }else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
@@ -0,0 +1,73 @@
+/**
+ * MappedAVLTree.h
+ */
+
+#ifndef MAPPEDAVLTREE_H
+#define MAPPEDAVLTREE_H
+#include "AVLTree.h"
+#include "AVLTreeFormat.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ *Read-only view of a snapshot written by AVLTree::save. The file is memory-mapped and searched in place:
+ *lookups binary search the file's index, so opening it does not build any nodes and the pages are
+ *shared with other processes mapping the same file. Nothing is copied until a result is returned.
+ *Any number of threads can read it at once, since nothing in it changes after open.
+ */
+class MappedAVLTree {
+public:
+    using KeyType = AVLTree::KeyType;
+    using ValueType = AVLTree::ValueType;
+
+    MappedAVLTree();
+
+    MappedAVLTree(const MappedAVLTree&) = delete;
+    MappedAVLTree& operator=(const MappedAVLTree&) = delete;
+
+    /**
+     *Unmaps the file
+     */
+    ~MappedAVLTree();
+
+    /**
+     *Maps a snapshot file, closing the one that was open. Returns false if the file cannot be mapped,
+     *or is truncated, fails its checksum or has another version.
+     *The checks read the whole file once, which also brings its pages into memory
+     */
+    bool open(const std::string& path);
+
+    /**
+     *Unmaps the file. The tree is then empty
+     */
+    void close();
+
+    bool isOpen() const;
+
+    /**
+     *Lookups with the same meaning as the AVLTree functions of the same name, in O(log n) key comparisons
+     */
+    bool contains(std::string_view key) const;
+    std::optional<ValueType> get(std::string_view key) const;
+    std::vector<ValueType> findRange(std::string_view lowKey, std::string_view highKey) const;
+    std::vector<KeyType> keys() const;
+    size_t size() const;
+
+private:
+    //start of the mapping, or null when no file is open
+    const char* data;
+    size_t mappedSize;
+    AVLTreeFormat::FileHeader header;
+
+    //the key and value of the record at the given position in key order
+    std::string_view keyAt(size_t index) const;
+    ValueType valueAt(size_t index) const;
+
+    //position of the first record whose key is not less than the given key, or size()
+    size_t lowerBound(std::string_view key) const;
+};
+
+#endif //MAPPEDAVLTREE_H
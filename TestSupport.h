@@ -0,0 +1,64 @@
+/**
+ * TestSupport.h
+ *
+ * Checks and helpers shared by the test programs. A test calls check for each thing it verifies and
+ * returns testResult() from main, so ctest sees it fail if any check did.
+ */
+
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+
+namespace TestSupport {
+
+    //checks that failed so far. Atomic, since some tests check from several threads
+    inline std::atomic<size_t> failures{0};
+    inline std::mutex reportMutex;
+    //only the first failures are printed, so one broken invariant does not bury the rest
+    constexpr size_t REPORTED_FAILURES = 20;
+
+    inline void check(bool condition, const std::string& what)
+    {
+        if (!condition && failures++ < REPORTED_FAILURES)
+        {
+            std::lock_guard lock(reportMutex);
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+
+    //prints the outcome and returns the exit code for main: 1 if any check failed
+    inline int testResult()
+    {
+        std::cout << (failures == 0 ? "all checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+
+    inline std::string readFile(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    inline void writeFile(const std::string& path, const std::string& contents)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    //fixed-width keys, so string order matches numeric order
+    inline std::string makeKey(size_t i)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "key/%06zu", i);
+        return buffer;
+    }
+}
+
+#endif //TESTSUPPORT_H
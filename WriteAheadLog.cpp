@@ -0,0 +1,383 @@
+#include "WriteAheadLog.h"
+#include "AVLTreeFormat.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//CRC-32C lookup table for the reflected polynomial, one byte per step
+static constexpr std::array<uint32_t, 256> CRC_TABLE = [] {
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) != 0 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+//write and read until every byte is done, retrying after signals
+static bool writeAll(int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytesRead = ::read(fd, data, length);
+        if (bytesRead <= 0)
+        {
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+//splits a payload into a record. Returns false for a payload no version of append writes
+static bool decodeRecord(const char* payload, size_t length, WriteAheadLog::Record& record)
+{
+    using RecordType = WriteAheadLog::RecordType;
+
+    record.type = static_cast<RecordType>(payload[0]);
+    record.highKey = {};
+    record.value = 0;
+    const char* rest = payload + 1;
+    size_t restLength = length - 1;
+    switch (record.type)
+    {
+        case RecordType::Insert:
+        case RecordType::Assign:
+            if (restLength < sizeof(uint64_t))
+            {
+                return false;
+            }
+            memcpy(&record.value, rest, sizeof(uint64_t));
+            record.key = std::string_view(rest + sizeof(uint64_t), restLength - sizeof(uint64_t));
+            return true;
+        case RecordType::Remove:
+            record.key = std::string_view(rest, restLength);
+            return true;
+        case RecordType::EraseRange:
+        {
+            uint32_t lowLength;
+            if (restLength < sizeof(lowLength))
+            {
+                return false;
+            }
+            memcpy(&lowLength, rest, sizeof(lowLength));
+            rest += sizeof(lowLength);
+            restLength -= sizeof(lowLength);
+            if (lowLength > restLength)
+            {
+                return false;
+            }
+            record.key = std::string_view(rest, lowLength);
+            record.highKey = std::string_view(rest + lowLength, restLength - lowLength);
+            return true;
+        }
+    }
+    return false;
+}
+
+WriteAheadLog::WriteAheadLog()
+{
+    fd = -1;
+    unsynced = false;
+    failed = false;
+    stopping = false;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    close();
+}
+
+//reads the whole log, replays it, cuts off a damaged tail and starts the background writer.
+//The file is opened for appending, so every write lands at its end, also after truncate
+bool WriteAheadLog::open(const std::string& path, Options options, const std::function<void(const Record&)>& replay)
+{
+    close();
+
+    int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    std::string contents;
+    if (fstat(file, &status) != 0)
+    {
+        ::close(file);
+        return false;
+    }
+    contents.resize(status.st_size);
+    if (!readAll(file, contents.data(), contents.size()))
+    {
+        ::close(file);
+        return false;
+    }
+
+    LogHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    const char* headerBytes = reinterpret_cast<const char*>(&header);
+
+    size_t validLength;
+    if (contents.size() < sizeof(header))
+    {
+        //a new log, or one whose header a crash cut short. Anything else this short is not a log
+        if (memcmp(contents.data(), headerBytes, contents.size()) != 0
+            || ftruncate(file, 0) != 0
+            || !writeAll(file, headerBytes, sizeof(header))
+            || fdatasync(file) != 0)
+        {
+            ::close(file);
+            return false;
+        }
+        validLength = sizeof(header);
+    }else
+    {
+        if (memcmp(contents.data(), headerBytes, sizeof(header)) != 0)
+        {
+            ::close(file);
+            return false;
+        }
+        validLength = sizeof(header) + replayRecords(std::string_view(contents).substr(sizeof(header)), replay);
+        //drops the torn or damaged tail, so new records follow the last good one
+        if (validLength < contents.size() && (ftruncate(file, validLength) != 0 || fdatasync(file) != 0))
+        {
+            ::close(file);
+            return false;
+        }
+    }
+
+    fd = file;
+    this->options = options;
+    unsynced = false;
+    failed = false;
+    stopping = false;
+    if (options.sync != SyncPolicy::Always)
+    {
+        flusher = std::thread(&WriteAheadLog::flushLoop, this);
+    }
+    return true;
+}
+
+bool WriteAheadLog::appendInsert(std::string_view key, uint64_t value)
+{
+    return append(RecordType::Insert, key, {}, &value);
+}
+
+bool WriteAheadLog::appendAssign(std::string_view key, uint64_t value)
+{
+    return append(RecordType::Assign, key, {}, &value);
+}
+
+bool WriteAheadLog::appendRemove(std::string_view key)
+{
+    return append(RecordType::Remove, key, {}, nullptr);
+}
+
+bool WriteAheadLog::appendEraseRange(std::string_view lowKey, std::string_view highKey)
+{
+    return append(RecordType::EraseRange, lowKey, highKey, nullptr);
+}
+
+//builds the record in place at the end of the buffer, then fills in its length and CRC
+bool WriteAheadLog::append(RecordType type, std::string_view first, std::string_view second, const uint64_t* value)
+{
+    //a payload has to fit its uint32 length. A record that is too long is refused on its own, since nothing was written
+    if (failed.load(std::memory_order_acquire) || first.size() + second.size() > UINT32_MAX - 2 * sizeof(uint64_t))
+    {
+        return false;
+    }
+    {
+        std::lock_guard lock(bufferMutex);
+        size_t start = buffer.size();
+        buffer.resize(start + RECORD_HEADER_SIZE);
+        buffer.push_back(static_cast<char>(type));
+        if (value != nullptr)
+        {
+            buffer.append(reinterpret_cast<const char*>(value), sizeof(*value));
+        }
+        if (type == RecordType::EraseRange)
+        {
+            uint32_t lowLength = static_cast<uint32_t>(first.size());
+            buffer.append(reinterpret_cast<const char*>(&lowLength), sizeof(lowLength));
+        }
+        buffer.append(first);
+        buffer.append(second);
+
+        char* record = buffer.data() + start;
+        uint32_t payloadLength = static_cast<uint32_t>(buffer.size() - start - RECORD_HEADER_SIZE);
+        uint32_t crc = checksum(record + RECORD_HEADER_SIZE, payloadLength);
+        memcpy(record, &payloadLength, sizeof(payloadLength));
+        memcpy(record + sizeof(payloadLength), &crc, sizeof(crc));
+    }
+    if (options.sync == SyncPolicy::Always)
+    {
+        return flush(true);
+    }
+    return !failed.load(std::memory_order_acquire);
+}
+
+bool WriteAheadLog::sync()
+{
+    return flush(true);
+}
+
+//takes the buffer with a swap, so appends go on while the records are written. After a failed write
+//nothing more is written: a record after a torn one would be cut off by the next open anyway
+bool WriteAheadLog::flush(bool syncToDisk)
+{
+    std::lock_guard fileLock(fileMutex);
+    if (fd < 0)
+    {
+        return !failed;
+    }
+    {
+        std::lock_guard lock(bufferMutex);
+        writing.swap(buffer);
+    }
+    if (!writing.empty() && !failed)
+    {
+        failed = !writeAll(fd, writing.data(), writing.size());
+        unsynced = true;
+    }
+    writing.clear();
+    if (syncToDisk && unsynced && !failed)
+    {
+        failed = fdatasync(fd) != 0;
+        unsynced = false;
+    }
+    return !failed;
+}
+
+//stopping is guarded by bufferMutex, which is let go while flushing
+void WriteAheadLog::flushLoop()
+{
+    bool syncToDisk = options.sync == SyncPolicy::Interval;
+    std::unique_lock lock(bufferMutex);
+    while (!stopping)
+    {
+        wakeFlusher.wait_for(lock, options.interval, [this] { return stopping; });
+        lock.unlock();
+        flush(syncToDisk);
+        lock.lock();
+    }
+}
+
+bool WriteAheadLog::truncate()
+{
+    std::lock_guard fileLock(fileMutex);
+    if (fd < 0)
+    {
+        return false;
+    }
+    {
+        std::lock_guard lock(bufferMutex);
+        buffer.clear();
+    }
+    if (ftruncate(fd, sizeof(LogHeader)) != 0 || fdatasync(fd) != 0)
+    {
+        failed = true;
+        return false;
+    }
+    unsynced = false;
+    failed = false;
+    return true;
+}
+
+void WriteAheadLog::close()
+{
+    if (flusher.joinable())
+    {
+        {
+            std::lock_guard lock(bufferMutex);
+            stopping = true;
+        }
+        wakeFlusher.notify_one();
+        flusher.join();
+    }
+    if (fd >= 0)
+    {
+        flush(options.sync != SyncPolicy::Never);
+        ::close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+    stopping = false;
+}
+
+bool WriteAheadLog::isOpen() const
+{
+    return fd >= 0;
+}
+
+bool WriteAheadLog::hasFailed() const
+{
+    return failed.load(std::memory_order_acquire);
+}
+
+//a record whose length runs past the end of the file, whose CRC does not match or that does not decode
+//ends the log. A crash can only leave such a record last, since records are appended in order
+size_t WriteAheadLog::replayRecords(std::string_view records, const std::function<void(const Record&)>& replay)
+{
+    size_t offset = 0;
+    while (records.size() - offset >= RECORD_HEADER_SIZE)
+    {
+        uint32_t payloadLength;
+        uint32_t crc;
+        memcpy(&payloadLength, records.data() + offset, sizeof(payloadLength));
+        memcpy(&crc, records.data() + offset + sizeof(payloadLength), sizeof(crc));
+        const char* payload = records.data() + offset + RECORD_HEADER_SIZE;
+        Record record;
+        if (payloadLength == 0 || payloadLength > records.size() - offset - RECORD_HEADER_SIZE
+            || checksum(payload, payloadLength) != crc || !decodeRecord(payload, payloadLength, record))
+        {
+            break;
+        }
+        replay(record);
+        offset += RECORD_HEADER_SIZE + payloadLength;
+    }
+    return offset;
+}
+
+uint32_t WriteAheadLog::checksum(const char* data, size_t length)
+{
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = CRC_TABLE[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,177 @@
+/**
+ * WriteAheadLog.h
+ *
+ * Append-only log of tree mutations, used by DurableAVLTree. The file is
+ *
+ *   LogHeader     "AVLTWAL" plus a zero byte, a uint32 version and a uint32 that is zero
+ *   records       each one a uint32 payload length, the uint32 CRC-32C of the payload, and the payload
+ *
+ * A payload is a one-byte RecordType followed by
+ *   Insert, Assign   a uint64 value and the key bytes
+ *   Remove           the key bytes
+ *   EraseRange       a uint32 length of the low key, the low key and the high key
+ *
+ * All integers are little-endian, like the snapshot format in AVLTreeFormat.h.
+ */
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ *Records are gathered in a buffer and written together, so many mutations share one write and one fsync
+ *(group commit). When that happens is set by the SyncPolicy. Appending takes a short lock on the buffer,
+ *so it costs about as much as copying the record, whatever the policy, except for SyncPolicy::Always
+ */
+class WriteAheadLog {
+public:
+    /**
+     *Always     every append is written and synced to disk before it returns true. Nothing acknowledged is lost, but each
+     *           mutation waits for the disk
+     *Interval   a background thread writes and syncs the buffer every interval. A power failure loses at most the
+     *           mutations of the last interval
+     *Never      the background thread writes the buffer every interval and leaves syncing to the operating system.
+     *           Survives the process crashing once a write happened, but not the machine
+     */
+    enum class SyncPolicy { Always, Interval, Never };
+
+    struct Options {
+        SyncPolicy sync = SyncPolicy::Interval;
+        std::chrono::milliseconds interval = std::chrono::milliseconds(5);
+    };
+
+    enum class RecordType : uint8_t { Insert = 1, Assign = 2, Remove = 3, EraseRange = 4 };
+
+    /**
+     *A decoded record, as passed to the replay function. highKey is only used by EraseRange and value only by Insert and Assign
+     */
+    struct Record {
+        RecordType type;
+        std::string_view key;
+        std::string_view highKey;
+        uint64_t value;
+    };
+
+    WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     *Writes out what is buffered and closes the log
+     */
+    ~WriteAheadLog();
+
+    /**
+     *Opens the log at path, creating it if it is missing, and calls replay for each record in it in order.
+     *A record cut short or damaged by a crash ends the log: it and everything after it are cut off, and new
+     *records are appended in their place. Returns false if the file cannot be opened or is not a log
+     */
+    bool open(const std::string& path, Options options, const std::function<void(const Record&)>& replay);
+
+    /**
+     *Append one record. Returns false, appending nothing, if the log has failed or the keys are too long for a record.
+     *Under SyncPolicy::Always it also returns false if the record could not be written and synced, which fails
+     *the log. Such a record may still have reached the disk, if only the sync failed. Under the other policies
+     *the record is written later, and a write that fails then shows in the next append or sync
+     */
+    bool appendInsert(std::string_view key, uint64_t value);
+    bool appendAssign(std::string_view key, uint64_t value);
+    bool appendRemove(std::string_view key);
+    bool appendEraseRange(std::string_view lowKey, std::string_view highKey);
+
+    /**
+     *Writes every appended record and syncs the file, whatever the policy. Returns false if this or any
+     *earlier write or sync failed since the log was opened, in which case records may be missing from the file
+     */
+    bool sync();
+
+    /**
+     *Empties the log, dropping records not yet written too, once a snapshot holds everything in it.
+     *Also clears an earlier failure, since the snapshot holds what the log may have missed.
+     *Returns false if the file could not be cut
+     */
+    bool truncate();
+
+    /**
+     *Whether a write or sync failed since the log was opened or last truncated
+     */
+    bool hasFailed() const;
+
+    /**
+     *Writes out what is buffered, stops the background thread and closes the file
+     */
+    void close();
+
+    bool isOpen() const;
+
+private:
+    struct LogHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    static constexpr char MAGIC[8] = {'A', 'V', 'L', 'T', 'W', 'A', 'L', '\0'};
+    static constexpr uint32_t VERSION = 1;
+    //payload length and CRC in front of every payload
+    static constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+    int fd;
+    Options options;
+
+    //records appended since the last write. Guarded by bufferMutex
+    std::string buffer;
+    std::mutex bufferMutex;
+
+    //the records being written. Guarded by fileMutex, which also keeps writes in order
+    std::string writing;
+    std::mutex fileMutex;
+    //set by a write that has not been synced yet
+    bool unsynced;
+    //set by a failed write or sync. Cleared by open and truncate. Only changed under fileMutex, but atomic
+    //so append can check it without waiting for a write in progress
+    std::atomic<bool> failed;
+
+    //background writer for SyncPolicy::Interval and Never
+    std::thread flusher;
+    std::condition_variable wakeFlusher;
+    bool stopping;
+
+    /**
+     *Adds a record with the given payload parts to the buffer, and writes it out at once under SyncPolicy::Always.
+     *Returns what the append functions return
+     */
+    bool append(RecordType type, std::string_view first, std::string_view second, const uint64_t* value);
+
+    /**
+     *Writes the buffered records to the file and syncs it if syncToDisk is set. Returns false if the log has failed
+     */
+    bool flush(bool syncToDisk);
+
+    /**
+     *Body of the background thread. Flushes every interval until close
+     */
+    void flushLoop();
+
+    /**
+     *Decodes the records that follow the header, calling replay for each one, and returns the length of the valid ones
+     */
+    static size_t replayRecords(std::string_view records, const std::function<void(const Record&)>& replay);
+
+    /**
+     *CRC-32C (Castagnoli) of a buffer
+     */
+    static uint32_t checksum(const char* data, size_t length);
+};
+
+#endif //WRITEAHEADLOG_H